@@ -0,0 +1,264 @@
+/*
+ * cmpq.c -- many deadlines multiplexed onto the one time compare register
+ *
+ * Deadlines are kept in a min-heap, and the compare register is armed with
+ * the earliest. When it fires, everything due is woken and the register is
+ * armed with the next one. A deadline that has already passed by the time
+ * the register is written would never match, so the board time is checked
+ * again after arming, and the waiter is woken with late set.
+ *
+ * The board is reached through cmpq_ops, so the logic can be tested against
+ * a simulated register file; build with -DMAIN to run the test.
+ * The caller supplies the locking.
+ */
+
+#ifdef MAIN
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#endif
+
+#define	CMPQ_MAX	128
+
+// Board times as a single number of microseconds that sorts in time order.
+// The day of year runs to 366, so years are 367 days long.
+#define	CMPQ_KEY(year, day, hour, min, sec, usec) \
+	((((((uint64_t)(year) * 367 + (day)) * 24 + (hour)) * 60 + (min)) * 60 + (sec)) * 1000000 + (usec))
+
+struct cmpq_waiter {
+	uint64_t	when;		// CMPQ_KEY
+	int		slot;		// index in the heap, or -1 once woken or removed
+};
+
+struct cmpq_ops {
+	uint64_t	(*now)(void *);				// current board time
+	void		(*arm)(void *, uint64_t);		// write the compare register
+	void		(*wake)(void *, struct cmpq_waiter *);	// w's deadline has passed
+};
+
+struct cmpq {
+	struct cmpq_waiter	*heap[CMPQ_MAX];
+	int			n;
+	uint64_t		armed;		// deadline in the register, 0 if none
+	bool			late;		// armed had passed once it was written
+};
+
+static void
+cmpq_init(struct cmpq *q)
+{
+	q->n = 0;
+	q->armed = 0;
+	q->late = false;
+}
+
+static void
+cmpq_swap(struct cmpq *q, int i, int j)
+{
+	struct cmpq_waiter *w = q->heap[i];
+
+	q->heap[i] = q->heap[j];
+	q->heap[j] = w;
+	q->heap[i]->slot = i;
+	q->heap[j]->slot = j;
+}
+
+static void
+cmpq_up(struct cmpq *q, int i)
+{
+	while (i > 0 && q->heap[i]->when < q->heap[(i - 1) / 2]->when) {
+		cmpq_swap(q, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void
+cmpq_down(struct cmpq *q, int i)
+{
+	int c;
+
+	for (;;) {
+		c = 2 * i + 1;
+		if (c >= q->n)
+			break;
+		if (c + 1 < q->n && q->heap[c + 1]->when < q->heap[c]->when)
+			c++;
+		if (q->heap[i]->when <= q->heap[c]->when)
+			break;
+		cmpq_swap(q, i, c);
+		i = c;
+	}
+}
+
+// return -1 if the queue is full
+static int
+cmpq_insert(struct cmpq *q, struct cmpq_waiter *w)
+{
+	if (q->n == CMPQ_MAX)
+		return -1;
+	w->slot = q->n;
+	q->heap[q->n++] = w;
+	cmpq_up(q, w->slot);
+	return 0;
+}
+
+// Take w out of the queue, eg when its sleep was interrupted. The register
+// is left armed for it until the next cmpq_run.
+static void
+cmpq_remove(struct cmpq *q, struct cmpq_waiter *w)
+{
+	int i = w->slot;
+
+	if (i < 0)
+		return;
+	w->slot = -1;
+	if (i == --q->n)
+		return;
+	q->heap[i] = q->heap[q->n];
+	q->heap[i]->slot = i;
+	cmpq_up(q, i);
+	cmpq_down(q, q->heap[i]->slot);
+}
+
+// Wake everything due, then arm the register for the earliest deadline left.
+// Called when a waiter is added and whenever the compare fires. A waiter
+// woken with when == armed and late clear was woken by the register.
+static void
+cmpq_run(struct cmpq *q, const struct cmpq_ops *ops, void *ctx)
+{
+	struct cmpq_waiter *w;
+	uint64_t now = ops->now(ctx);
+
+	for (;;) {
+		while (q->n > 0 && q->heap[0]->when <= now) {
+			w = q->heap[0];
+			cmpq_remove(q, w);
+			(*ops->wake)(ctx, w);
+		}
+		if (q->n == 0) {
+			q->armed = 0;
+			return;
+		}
+		if (q->heap[0]->when != q->armed) {
+			q->armed = q->heap[0]->when;
+			(*ops->arm)(ctx, q->armed);
+			now = ops->now(ctx);
+			q->late = now >= q->armed;
+		} else
+			now = ops->now(ctx);
+		if (now < q->armed)
+			return;
+	}
+}
+
+#ifdef MAIN
+/*
+ * A simulated board: time advances in random steps, and the compare
+ * "interrupt" fires when a step carries the time past the armed deadline.
+ * Writing the register takes a random time, so deadlines sometimes pass
+ * while they are being armed.
+ */
+struct sim {
+	uint64_t	time;
+	uint64_t	compare;
+	uint64_t	armed_at;	// time once compare was written
+	int		arms;
+	struct cmpq	*q;
+};
+
+struct test_waiter {
+	struct cmpq_waiter	w;		// first, so wake can cast back
+	uint64_t		woke;
+	int			wakes;
+};
+
+static uint64_t
+sim_now(void *ctx)
+{
+	return ((struct sim *)ctx)->time;
+}
+
+static void
+sim_arm(void *ctx, uint64_t when)
+{
+	struct sim *s = ctx;
+
+	s->compare = when;
+	s->arms++;
+	s->time += random() % 3;
+	s->armed_at = s->time;
+}
+
+static void
+sim_wake(void *ctx, struct cmpq_waiter *w)
+{
+	struct test_waiter *tw = (struct test_waiter *)w;
+	struct sim *s = ctx;
+
+	// the register was armed for w: late says whether it passed first
+	if (w->when == s->q->armed)
+		assert(s->q->late == (s->armed_at >= w->when));
+	tw->woke = s->time;
+	tw->wakes++;
+}
+
+static const struct cmpq_ops sim_ops = { sim_now, sim_arm, sim_wake };
+
+#define	NWAITERS	2000
+
+int
+main(int argc, char **argv)
+{
+	static struct test_waiter tw[NWAITERS];
+	struct cmpq q;
+	struct sim s = { 1000, 0, 0, 0, &q };
+	uint64_t prev;
+	int i, next = 0, removed = 0;
+
+	assert(CMPQ_KEY(2024, 366, 23, 59, 59, 999999) < CMPQ_KEY(2025, 1, 0, 0, 0, 0));
+	assert(CMPQ_KEY(2025, 1, 0, 0, 0, 1) - CMPQ_KEY(2025, 1, 0, 0, 0, 0) == 1);
+
+	srandom(1);
+	cmpq_init(&q);
+	while (next < NWAITERS || q.n > 0) {
+		// add a few waiters, some already due, while there is room
+		while (next < NWAITERS && q.n < CMPQ_MAX && random() % 4 != 0) {
+			tw[next].w.when = s.time + random() % 200 - 20;
+			assert(cmpq_insert(&q, &tw[next].w) == 0);
+			cmpq_run(&q, &sim_ops, &s);
+			next++;
+		}
+		// and give up on the odd one
+		if (q.n > 0 && random() % 50 == 0) {
+			struct test_waiter *t = (struct test_waiter *)q.heap[random() % q.n];
+			cmpq_remove(&q, &t->w);
+			t->wakes = -1;
+			removed++;
+		}
+
+		prev = s.time;
+		s.time += 1 + random() % 30;
+		if (q.armed != 0 && prev < s.compare && s.compare <= s.time)
+			cmpq_run(&q, &sim_ops, &s);
+
+		// nothing due may be left waiting, and the register must fire
+		// no later than the earliest deadline (a removed waiter may
+		// leave it armed earlier)
+		if (q.n > 0)
+			assert(q.armed <= q.heap[0]->when && q.armed > s.time);
+	}
+
+	for (i = 0; i < NWAITERS; ++i) {
+		if (tw[i].wakes == -1)
+			continue;
+		if (tw[i].wakes != 1 || tw[i].woke < tw[i].w.when) {
+			printf("waiter %d: due %ju, woken %d times, last at %ju\n", i,
+			    (uintmax_t)tw[i].w.when, tw[i].wakes, (uintmax_t)tw[i].woke);
+			exit(1);
+		}
+	}
+	printf("%d waiters, %d removed, %d compare writes\n", NWAITERS, removed, s.arms);
+	exit(0);
+}
+#endif
@@ -0,0 +1,248 @@
+/*
+ * layout.c -- fixed register block layouts, and codecs generated from them
+ *
+ * Each block is listed once, byte by byte, as a macro taking three
+ * callbacks:
+ *	N(hi, lo)	a byte of two BCD digits, or other nibbles
+ *	B(f)		a whole byte
+ *	W(f)		a signed little-endian 16 bit word
+ * LAYOUT() expands a list into a struct with a field for each nibble, byte
+ * and word, the block length <name>_len, and <name>_decode() and
+ * <name>_encode(), which copy the fields at constant offsets. They are
+ * straight-line code, unlike pack() and unpack(), which interpret a format
+ * string and walk a va_list on every call.
+ *
+ * Fields named unused* aren't used by the driver; encoders should be given
+ * zeros for them.
+ *
+ * Build with -DMAIN to check the codecs against pack() and unpack() and
+ * time them both.
+ */
+
+#ifdef MAIN
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <sys/types.h>
+typedef uint32_t bus_size_t;
+#undef MAIN
+#include "pack.c"
+#define MAIN
+#endif
+
+// the latched board time at 0xfc
+#define	LAYOUT_BCD_TIME(N, B, W)				\
+	N(tens_micro,		units_micro)			\
+	N(units_milli,		hundreds_micro)			\
+	N(unused0,		unused1)			\
+	N(hundreds_nano,	unused2)			\
+	N(hundreds_milli,	tens_milli)			\
+	N(tens_sec,		units_sec)			\
+	N(tens_min,		units_min)			\
+	N(tens_hour,		units_hour)			\
+	N(tens_day,		units_day)			\
+	N(unused3,		hundreds_day)			\
+	N(tens_year,		units_year)			\
+	N(thousands_year,	hundreds_year)
+
+// REG_TIME_COMPARE
+#define	LAYOUT_BCD_COMPARE(N, B, W)				\
+	N(tens_usec,		units_usec)			\
+	N(units_msec,		hundreds_usec)			\
+	N(hundreds_msec,	tens_msec)			\
+	N(tens_sec,		units_sec)			\
+	N(tens_min,		units_min)			\
+	N(tens_hour,		units_hour)			\
+	N(tens_day,		units_day)			\
+	N(mask,			hundreds_day)
+
+// REG_TZ_OFFSET
+#define	LAYOUT_BCD_TZ_OFFSET(N, B, W)				\
+	N(tens_min,		units_min)			\
+	N(tens_hour,		units_hour)			\
+	B(sign)							\
+	B(unused0)
+
+// REG_PHASE_COMP; the old model has only the usec word
+#define	LAYOUT_PHASE_COMP(N, B, W)				\
+	W(usec)							\
+	B(hnsec)
+
+#define	LAYOUT_PHASE_COMP_OLD(N, B, W)				\
+	W(usec)
+
+// REG_POSITION
+#define	LAYOUT_BCD_POSITION(N, B, W)				\
+	N(lat_tens_deg,		lat_units_deg)			\
+	N(unused0,		lat_hundreds_deg)		\
+	N(lat_tens_min,		lat_units_min)			\
+	B(lat_dir)						\
+	N(unused1,		lat_decisec)			\
+	N(lat_tens_sec,		lat_units_sec)			\
+	N(lon_tens_deg,		lon_units_deg)			\
+	N(unused2,		lon_hundreds_deg)		\
+	N(lon_tens_min,		lon_units_min)			\
+	B(lon_dir)						\
+	N(unused3,		lon_decisec)			\
+	N(lon_tens_sec,		lon_units_sec)			\
+	N(elev_tens_km,		elev_unit_km)			\
+	B(elev_sign)						\
+	N(elev_units_meter,	elev_decimeter)			\
+	N(elev_hundreds_meter,	elev_tens_meter)
+
+// one entry of the satellite table at 0x198
+#define	LAYOUT_BCD_SATELLITE(N, B, W)				\
+	N(tens_sv,		unit_sv)			\
+	B(unused0)						\
+	N(tenth_signal,		hundredth_signal)		\
+	N(tens_signal,		units_signal)
+
+#define	LAYOUT_FIELD_N(hi, lo)	uint8_t hi; uint8_t lo;
+#define	LAYOUT_FIELD_B(f)	uint8_t f;
+#define	LAYOUT_FIELD_W(f)	int16_t f;
+
+#define	LAYOUT_LEN_N(hi, lo)	+ 1
+#define	LAYOUT_LEN_B(f)		+ 1
+#define	LAYOUT_LEN_W(f)		+ 2
+
+#define	LAYOUT_DEC_N(hi, lo)	r->hi = *bp >> 4; r->lo = *bp++ & 0x0f;
+#define	LAYOUT_DEC_B(f)		r->f = *bp++;
+#define	LAYOUT_DEC_W(f)		r->f = (int16_t)(bp[0] | bp[1] << 8); bp += 2;
+
+#define	LAYOUT_ENC_N(hi, lo)	*bp++ = r->hi << 4 | r->lo;
+#define	LAYOUT_ENC_B(f)		*bp++ = r->f;
+#define	LAYOUT_ENC_W(f)		*bp++ = r->f; *bp++ = (uint16_t)r->f >> 8;
+
+#define	LAYOUT(name, list)						\
+struct name {								\
+	list(LAYOUT_FIELD_N, LAYOUT_FIELD_B, LAYOUT_FIELD_W)		\
+};									\
+enum { name##_len = 0 list(LAYOUT_LEN_N, LAYOUT_LEN_B, LAYOUT_LEN_W) };	\
+static __inline void							\
+name##_decode(const uint8_t *bp, struct name *r)			\
+{									\
+	list(LAYOUT_DEC_N, LAYOUT_DEC_B, LAYOUT_DEC_W)			\
+}									\
+static __inline void							\
+name##_encode(uint8_t *bp, const struct name *r)			\
+{									\
+	list(LAYOUT_ENC_N, LAYOUT_ENC_B, LAYOUT_ENC_W)			\
+}
+
+LAYOUT(bcd_time, LAYOUT_BCD_TIME)
+LAYOUT(bcd_compare, LAYOUT_BCD_COMPARE)
+LAYOUT(bcd_tz_offset, LAYOUT_BCD_TZ_OFFSET)
+LAYOUT(phase_comp, LAYOUT_PHASE_COMP)
+LAYOUT(phase_comp_old, LAYOUT_PHASE_COMP_OLD)
+LAYOUT(bcd_position, LAYOUT_BCD_POSITION)
+LAYOUT(bcd_satellite, LAYOUT_BCD_SATELLITE)
+
+#ifdef MAIN
+/*
+ * The same lists also give the format string and argument lists that
+ * pack() and unpack() would need, so each codec can be checked against the
+ * interpreter on random blocks, and both timed.
+ */
+#define	FMT_N(hi, lo)		"n"
+#define	FMT_B(f)		"c"
+#define	FMT_W(f)		"S"
+#define	PTR_N(hi, lo)		, &r->hi, &r->lo
+#define	PTR_B(f)		, &r->f
+#define	PTR_W(f)		, &r->f
+#define	ARG_N(hi, lo)		, r->hi, r->lo
+#define	ARG_B(f)		, r->f
+#define	ARG_W(f)		, r->f
+
+#define	ROUNDS		10000
+#define	ITERATIONS	10000000
+
+static volatile uint8_t sink;
+
+// make the compiler believe the whole of *p is used, so it can't skip the work
+#define	USE(p)		__asm __volatile("" : : "g"(p) : "memory")
+
+static double
+elapsed(struct timespec *t0)
+{
+	struct timespec t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0->tv_sec) * 1e9 + (t1.tv_nsec - t0->tv_nsec);
+}
+
+#define	CHECK(name, list)						\
+static void								\
+name##_check(void)							\
+{									\
+	char *fmt = "" list(FMT_N, FMT_B, FMT_W);			\
+	uint8_t buf[name##_len], buf1[name##_len], buf2[name##_len];	\
+	struct name s1, s2, *r;						\
+	struct timespec t0;						\
+	double gen, interp;						\
+	int i, j;							\
+									\
+	assert(packlen(fmt) == name##_len);				\
+	for (i = 0; i < ROUNDS; ++i) {					\
+		for (j = 0; j < name##_len; ++j)			\
+			buf[j] = random();				\
+		memset(&s1, 0, sizeof(s1));				\
+		memset(&s2, 0, sizeof(s2));				\
+		name##_decode(buf, &s1);				\
+		r = &s2;						\
+		unpack(buf, fmt list(PTR_N, PTR_B, PTR_W));		\
+		assert(memcmp(&s1, &s2, sizeof(s1)) == 0);		\
+		name##_encode(buf1, &s1);				\
+		r = &s1;						\
+		pack(buf2, fmt list(ARG_N, ARG_B, ARG_W));		\
+		assert(memcmp(buf, buf1, name##_len) == 0);		\
+		assert(memcmp(buf, buf2, name##_len) == 0);		\
+	}								\
+									\
+	clock_gettime(CLOCK_MONOTONIC, &t0);				\
+	for (i = 0; i < ITERATIONS; ++i) {				\
+		buf[0] = i;						\
+		name##_decode(buf, &s1);				\
+		USE(&s1);						\
+	}								\
+	gen = elapsed(&t0) / ITERATIONS;				\
+									\
+	r = &s2;							\
+	clock_gettime(CLOCK_MONOTONIC, &t0);				\
+	for (i = 0; i < ITERATIONS; ++i) {				\
+		buf[0] = i;						\
+		sink = packlen(fmt);					\
+		unpack(buf, fmt list(PTR_N, PTR_B, PTR_W));		\
+		USE(&s2);						\
+	}								\
+	interp = elapsed(&t0) / ITERATIONS;				\
+									\
+	printf("%-16s %2d bytes  decode %6.2f nsec  unpack+packlen %6.2f nsec\n", \
+	    #name, name##_len, gen, interp);				\
+}
+
+CHECK(bcd_time, LAYOUT_BCD_TIME)
+CHECK(bcd_compare, LAYOUT_BCD_COMPARE)
+CHECK(bcd_tz_offset, LAYOUT_BCD_TZ_OFFSET)
+CHECK(phase_comp, LAYOUT_PHASE_COMP)
+CHECK(phase_comp_old, LAYOUT_PHASE_COMP_OLD)
+CHECK(bcd_position, LAYOUT_BCD_POSITION)
+CHECK(bcd_satellite, LAYOUT_BCD_SATELLITE)
+
+int
+main(int argc, char **argv)
+{
+	srandom(1);
+	bcd_time_check();
+	bcd_compare_check();
+	bcd_tz_offset_check();
+	phase_comp_check();
+	phase_comp_old_check();
+	bcd_position_check();
+	bcd_satellite_check();
+	exit(0);
+}
+#endif
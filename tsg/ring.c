@@ -0,0 +1,221 @@
+/*
+ * ring.c -- fixed size record rings with independent readers
+ *
+ * A ring keeps the last nrecs records written to it.
+ * Each reader has its own cursor, so several readers can each see every
+ * record. A reader that falls more than nrecs records behind loses the
+ * oldest ones, and they are added to its lost count.
+ *
+ * The caller supplies the mutex protecting the ring.
+ * Readers can wait in read(2), poll(2) or kqueue(2).
+ */
+
+struct ring {
+	struct mtx	*mtx;
+	uint8_t		*recs;
+	size_t		recsize;
+	uint32_t	nrecs;		// must be a power of 2
+	uint64_t	head;		// number of records ever written
+	int		gone;		// device is going away
+	struct selinfo	sel;		// poll and kqueue waiters
+};
+
+struct ring_reader {
+	struct ring	*ring;
+	uint64_t	next;		// number of the next record to read
+	uint64_t	lost;		// records overwritten before we read them
+};
+
+static void
+ring_init(struct ring *r, struct mtx *mtx, size_t recsize, uint32_t nrecs)
+{
+	r->mtx = mtx;
+	r->recs = malloc(recsize * nrecs, M_DEVBUF, M_WAITOK | M_ZERO);
+	r->recsize = recsize;
+	r->nrecs = nrecs;
+	r->head = 0;
+	r->gone = 0;
+	knlist_init_mtx(&r->sel.si_note, mtx);
+}
+
+// the ring's device must already be destroyed, so no new waiters can turn up
+static void
+ring_destroy(struct ring *r)
+{
+	seldrain(&r->sel);
+	knlist_clear(&r->sel.si_note, 0);
+	knlist_destroy(&r->sel.si_note);
+	free(r->recs, M_DEVBUF);
+	r->recs = NULL;
+}
+
+// wake up any sleeping readers and make them return ENXIO
+static void
+ring_shutdown(struct ring *r)
+{
+	mtx_lock(r->mtx);
+	r->gone = 1;
+	wakeup(r);
+	selwakeup(&r->sel);
+	KNOTE_LOCKED(&r->sel.si_note, 0);
+	mtx_unlock(r->mtx);
+}
+
+static void
+ring_put(struct ring *r, void *rec)
+{
+	mtx_assert(r->mtx, MA_OWNED);
+	memcpy(r->recs + (r->head & (r->nrecs - 1)) * r->recsize, rec, r->recsize);
+	r->head++;
+	wakeup(r);
+	selwakeup(&r->sel);
+	KNOTE_LOCKED(&r->sel.si_note, 0);
+}
+
+// new readers only see records written after they start reading
+static void
+ring_reader_init(struct ring *r, struct ring_reader *rd)
+{
+	mtx_lock(r->mtx);
+	rd->ring = r;
+	rd->next = r->head;
+	rd->lost = 0;
+	mtx_unlock(r->mtx);
+}
+
+// return how many records rd has yet to read, skipping any it has lost
+static uint32_t
+ring_avail(struct ring *r, struct ring_reader *rd)
+{
+	mtx_assert(r->mtx, MA_OWNED);
+	if (r->head - rd->next > r->nrecs) {
+		rd->lost += r->head - rd->next - r->nrecs;
+		rd->next = r->head - r->nrecs;
+	}
+	return r->head - rd->next;
+}
+
+// copy up to n of rd's unread records into buf; return the number copied
+static uint32_t
+ring_get(struct ring *r, struct ring_reader *rd, void *buf, uint32_t n)
+{
+	uint8_t *bp = buf;
+	uint32_t i;
+
+	n = MIN(n, ring_avail(r, rd));
+	for (i = 0; i < n; ++i) {
+		memcpy(bp, r->recs + (rd->next & (r->nrecs - 1)) * r->recsize, r->recsize);
+		bp += r->recsize;
+		rd->next++;
+	}
+	return n;
+}
+
+// sleep until rd has something to read; timo is in ticks, 0 means forever
+static int
+ring_wait(struct ring *r, struct ring_reader *rd, int timo)
+{
+	int error;
+
+	mtx_assert(r->mtx, MA_OWNED);
+	while (ring_avail(r, rd) == 0) {
+		if (r->gone)
+			return ENXIO;
+		error = msleep(r, r->mtx, PCATCH, "tsgrng", timo);
+		if (error)
+			return error;
+	}
+	return 0;
+}
+
+// read(2) as many whole records as are available and fit in uio,
+// blocking for the first one unless the file is non-blocking
+static int
+ring_read(struct ring *r, struct ring_reader *rd, struct uio *uio, int ioflag)
+{
+	uint8_t buf[512];
+	uint32_t n;
+	int error;
+
+	if (uio->uio_resid < r->recsize || r->recsize > sizeof(buf))
+		return EINVAL;
+
+	mtx_lock(r->mtx);
+	if ((ioflag & O_NONBLOCK) && ring_avail(r, rd) == 0)
+		error = EWOULDBLOCK;
+	else
+		error = ring_wait(r, rd, 0);
+
+	while (error == 0 && uio->uio_resid >= r->recsize) {
+		n = ring_get(r, rd, buf, MIN(uio->uio_resid, sizeof(buf)) / r->recsize);
+		if (n == 0)
+			break;
+		// uiomove may fault, so it can't be done with the ring locked
+		mtx_unlock(r->mtx);
+		error = uiomove(buf, n * r->recsize, uio);
+		mtx_lock(r->mtx);
+	}
+	mtx_unlock(r->mtx);
+	return error;
+}
+
+// poll(2): readable when rd has a record waiting or the device has gone
+static int
+ring_poll(struct ring *r, struct ring_reader *rd, int events, struct thread *td)
+{
+	int revents = 0;
+
+	if ((events & (POLLIN | POLLRDNORM)) == 0)
+		return 0;
+	mtx_lock(r->mtx);
+	if (ring_avail(r, rd) > 0 || r->gone)
+		revents = events & (POLLIN | POLLRDNORM);
+	else
+		selrecord(td, &r->sel);
+	mtx_unlock(r->mtx);
+	return revents;
+}
+
+// kqueue(2) EVFILT_READ; kn_data is the number of unread records.
+// The knlist lock is the ring's mutex, so these are called with it held.
+static int
+ring_kqread(struct knote *kn, long hint)
+{
+	struct ring_reader *rd = kn->kn_hook;
+	struct ring *r = rd->ring;
+
+	mtx_assert(r->mtx, MA_OWNED);
+	kn->kn_data = ring_avail(r, rd);
+	if (r->gone) {
+		kn->kn_flags |= EV_EOF;
+		return 1;
+	}
+	return kn->kn_data > 0;
+}
+
+static void
+ring_kqdetach(struct knote *kn)
+{
+	struct ring_reader *rd = kn->kn_hook;
+
+	knlist_remove(&rd->ring->sel.si_note, kn, 0);
+}
+
+static struct filterops ring_read_filterops = {
+	.f_isfd = 1,
+	.f_detach = ring_kqdetach,
+	.f_event = ring_kqread,
+};
+
+// the reader outlives the knote: knotes are dropped when the descriptor
+// is closed, before the cdevpriv holding the reader is freed
+static int
+ring_kqfilter(struct ring *r, struct ring_reader *rd, struct knote *kn)
+{
+	if (kn->kn_filter != EVFILT_READ)
+		return EINVAL;
+	kn->kn_fop = &ring_read_filterops;
+	kn->kn_hook = rd;
+	knlist_add(&r->sel.si_note, kn, 0);
+	return 0;
+}
@@ -7,16 +7,34 @@
  *  560-5908-U GPS-PCI-2U
  */
 
+#ifdef TSG_SIM
+#include "kern.h"	// userland build against simulated registers, see tsgsim/
+#else
 #include <sys/param.h>
 #include <sys/module.h>
 #include <sys/kernel.h>
 #include <sys/lock.h>
 #include <sys/mutex.h>
+#include <sys/sx.h>
+#include <sys/rwlock.h>
+#include <sys/callout.h>
+#include <sys/taskqueue.h>
+#include <sys/malloc.h>
+#include <sys/fcntl.h>
+#include <sys/mman.h>
+#include <sys/poll.h>
+#include <sys/selinfo.h>
+#include <sys/event.h>
+#include <sys/endian.h>
+#include <sys/sysctl.h>
+#include <sys/sbuf.h>
 
 #include <sys/conf.h>
 #include <sys/uio.h>
 #include <sys/bus.h>
+#include <machine/atomic.h>
 #include <machine/bus.h>
+#include <machine/cpu.h>
 #include <machine/stdarg.h>
 
 #include <sys/rman.h>
@@ -24,7 +42,16 @@
 #include <dev/pci/pcireg.h>
 #include <dev/pci/pcivar.h>
 
+#include <vm/vm.h>
+#include <vm/vm_param.h>
+#include <vm/vm_extern.h>
+#include <vm/vm_object.h>
+#include <vm/vm_page.h>
+#include <vm/vm_pager.h>
+#include <vm/pmap.h>
+
 #include <sys/timepps.h>
+#endif
 
 #include "tsg.h"
 
@@ -54,6 +81,7 @@
 #define		TSG_CLEAR_COMPARE	0x02
 #define		TSG_CLEAR_EXT		0x01
 #define	REG_LOCK_STATUS		0x105
+#define	REG_POSITION		0x108	// GPS position
 #define	REG_CONFIG		0x118	// Configuration Register #1
 #define		TSG_PRESET_TIME_READY	0x04
 #define		TSG_PRESET_POS_READY	0x80
@@ -69,16 +97,196 @@
 
 #define	UNUSED(x)	(x) __attribute__((unused))
 
+#include "ring.c"
+#include "cmpq.c"
+
+/* event sources; each has its own PPS API device */
+#define	SRC_COMPARE	0
+#define	SRC_EXT		1
+#define	SRC_PULSE	2
+#define	SRC_SYNTH	3
+#define	NSOURCES	4
+
+// number of events each source keeps for read(2)
+#define	EVENT_RING_SIZE	1024
+#define	STATUS_RING_SIZE	64	// status changes kept for the main device
+
+struct tsg_source {
+	char		*name;		// device name suffix
+	uint8_t		enable;		// TSG_INT_ENABLE_* bit
+	uint8_t		intr;		// TSG_INTR_* bit
+	uint8_t		clear;		// TSG_CLEAR_* bit
+
+	// Edges fall at phase + k * period nsec into each board second; period
+	// is 0 if the edges aren't on a known grid. Written under latch_mtx by
+	// update_edge_grid. The ithread reads them unlocked, so an event racing
+	// a reconfiguration may be placed on the old grid.
+	uint32_t	period;
+	uint32_t	phase;
+
+	// rate limiting and decimation in tsg_filter, protected by latch_mtx
+	uint32_t	decimate;	// deliver every decimate'th edge
+	uint32_t	edges;		// edges since the last one delivered
+	uint32_t	max_rate;	// edges per second before masking the source
+	uint32_t	rate_count;	// edges since rate_start
+	int		rate_start;	// ticks
+
+	struct cdev	*cdev;
+
+	struct mtx	mtx;		// protects everything below
+	struct pps_state pps_state;
+	struct tsg_time	time;		// board time latched at the last event
+	uint64_t	cycles;		// cycle counter at that latch
+	struct ring	ring;		// recent events (struct tsg_event)
+
+	// latest event, for mmap(2) readers; updated under a sequence counter.
+	// page is the kernel mapping of page_m, the only page of page_obj.
+	struct tsg_event_page *page;
+	vm_object_t	page_obj;
+	vm_page_t	page_m;
+};
+
+CTASSERT(sizeof(struct tsg_event_page) <= PAGE_SIZE);
+
+// the same for 32 and 64 bit programs
+CTASSERT(sizeof(struct tsg_schedule) == 32);
+CTASSERT(sizeof(struct tsg_batch_entry) == 16);
+CTASSERT(sizeof(struct tsg_batch) == 16);
+CTASSERT(sizeof(struct tsg_telemetry_history) == 16);
+CTASSERT(sizeof(struct tsg_offset_sample) == 56);
+CTASSERT(sizeof(struct tsg_clock_offset) == 8 + TSG_OFFSET_MAX_SAMPLES * 56);
+CTASSERT(sizeof(struct tsg_time_cycles) == 24);
+CTASSERT(sizeof(struct tsg_event) == 72);
+CTASSERT(sizeof(struct tsg_event_stats) == 24);
+CTASSERT(sizeof(struct tsg_event_wait) == 80);
+CTASSERT(sizeof(struct tsg_status_change) == 32);
+CTASSERT(sizeof(struct tsg_telemetry) == 48);
+CTASSERT(sizeof(struct tsg_telemetry_current) == 56);
+
+// register bus transactions made by one handler
+struct tsg_busacct {
+	uint64_t	calls;
+	uint64_t	reads;
+	uint64_t	writes;
+};
+
+// per command accounting for the main device ioctls; times are in
+// nanoseconds and only cover the handler, not waiting for cfg_lock
+struct tsg_cmdstats {
+	struct tsg_busacct	bus;
+	uint64_t		errors;
+	uint64_t		nsec_total;
+	uint64_t		nsec_max;
+};
+
+// Interrupt path statistics, protected by latch_mtx. The histograms count
+// handler run times in CPU cycles: bucket i holds runs shorter than 2^i
+// cycles that don't fit in bucket i-1, and the last bucket all longer ones.
+#define	TSG_HIST_BUCKETS	32
+
+struct tsg_intrstats {
+	uint64_t	interrupts;		// filter runs
+	uint64_t	stray;			// none of our enabled events had occurred
+	uint64_t	deferred;		// the previous latch was still uncollected
+	uint64_t	events[NSOURCES];	// events captured, by source
+	uint64_t	throttled[NSOURCES];	// times each source was masked for its rate
+	uint64_t	filter_cycles[TSG_HIST_BUCKETS];
+	uint64_t	ithrd_cycles[TSG_HIST_BUCKETS];
+};
+
+// Host copy of a control register, so setters don't have to read the board
+// before writing it and getters of configuration bits don't touch the bus.
+// Protected by cfg_lock.
+struct tsg_shadow {
+	bus_size_t	reg;
+	uint8_t		strobes;	// self-clearing command bits; written as 0 unless being set
+	uint8_t		live;		// bits the firmware changes; always read from the board
+	uint8_t		value;		// every other bit, as last read or written
+	bool		valid;
+};
+
 struct tsg_softc {
 	device_t	device;
 
 	struct cdev	*cdev;		// main device
-	struct cdev	*cdev_compare;	// .compare device
-	struct cdev	*cdev_ext;	// .ext device
-	struct cdev	*cdev_pulse;	// .pulse device
-	struct cdev	*cdev_synth;	// .synth device
 
-	struct mtx	mtx;
+	// cfg_lock serialises the ioctl handlers. It is sleepable, so handlers
+	// can wait for the board, and the interrupt handlers never take it.
+	struct sx	cfg_lock;
+
+	// latch_mtx is a spin lock shared with tsg_filter. It serialises writes
+	// to the 0xfc latch and the hardware control register, and protects
+	// the intmasks, pending and latch_sleepers.
+	struct mtx	latch_mtx;
+	int		latch_sleepers;		// ioctls in latch_lock waiting for pending to clear
+
+	// lock contention counts
+	uint64_t	cfg_contended;		// ioctls that waited for another ioctl
+	uint64_t	latch_contended;	// filter runs that found latch_mtx held
+	uint64_t	latch_waits;		// ioctl latches that waited for the ithread
+
+	struct tsg_intrstats	intr_stats;
+
+	// cmp_mtx protects cmpq and the time compare register. TSG_WAIT_UNTIL
+	// sleepers queue on cmpq, which keeps the register armed for the
+	// earliest of them.
+	struct mtx	cmp_mtx;
+	struct cmpq	cmpq;
+	bool		cmp_rerun;	// cmpq_run found the latch busy; tsg_ithrd runs it again
+	uint64_t	cmp_time;	// board time cmp_now last read, as a CMPQ_KEY
+	bool		cmp_gone;	// device is going away
+
+	// compare schedule loaded by TSG_SET_SCHEDULE, also under cmp_mtx.
+	// sched_w is queued on cmpq at sched_time, the next strobe.
+	struct cmpq_waiter sched_w;
+	uint8_t		sched_state;	// TSG_SCHEDULE_*
+	struct tsg_time	*sched_times;	// list schedule
+	uint32_t	sched_count;
+	uint32_t	sched_period;	// periodic schedule
+	bool		sched_forever;
+	uint32_t	sched_left;
+	struct tsg_time	sched_time;
+	uint32_t	sched_fired;
+	uint32_t	sched_missed;
+
+	// notify_mtx protects the preset, watch and benchmark state, and
+	// main_sel, which wakes up poll(2) and kqueue(2) on the main device
+	struct mtx	notify_mtx;
+	struct selinfo	main_sel;
+
+	// status registers sampled by watch_callout every watch_ms. Changes
+	// are queued on status_ring for read(2) on the main device; the sample
+	// is cached in telemetry, and kept in telemetry_ring once a second.
+	struct callout	watch_callout;
+	uint32_t	watch_ms;
+	bool		watch_valid;	// telemetry holds a sample
+	uint32_t	watch_seq;	// status changes queued
+	struct tsg_telemetry telemetry;
+	int		telemetry_ticks;	// when telemetry was sampled
+	int		telemetry_kept;		// when telemetry_ring last got one
+	struct ring	status_ring;
+	struct ring	telemetry_ring;
+
+	// clock presets started by TSG_SET_CLOCK_TIME and tracked by preset_callout
+	struct callout	preset_callout;
+	uint8_t		preset_state;	// TSG_PRESET_*
+	uint32_t	preset_gen;	// presets started
+	uint32_t	preset_done;	// generation of the last one to finish
+	int		preset_start;	// ticks when it started
+	int		preset_ticks;	// how long it took
+
+	// interrupt latency benchmark started by TSG_START_BENCH and ended by
+	// bench_task, which puts back the saved pulse frequency and intmask
+	struct timeout_task	bench_task;
+	uint8_t		bench_state;	// TSG_BENCH_*
+	uint8_t		bench_freq;
+	uint32_t	bench_seconds;
+	uint8_t		bench_saved_freq;
+	uint8_t		bench_saved_intmask;
+	uint64_t	bench_samples;
+	uint32_t	bench_min;
+	uint32_t	bench_max;
+	uint32_t	*bench_hist;	// TSG_BENCH_BINS
 
 	int		lcr_rid;
 	struct resource	*lcr_resource;
@@ -101,93 +309,213 @@ struct tsg_softc {
 	uint8_t		test;
 
 	// intmask determines which events should generate interrupts.
-	// (TSG_INT_ENABLE_*)
+	// (TSG_INT_ENABLE_*) It is intmask_user, set by TSG_SET_INT_MASK,
+	// plus intmask_wait, the compare interrupt while cmpq has sleepers.
 	uint8_t 	intmask;
-
-	// We manage four PPS API interfaces
-	struct pps_state	pps_state_compare;
-	struct mtx		pps_mtx_compare;
-	struct tsg_time		pps_time_compare;
-
-	struct pps_state	pps_state_ext;
-	struct mtx		pps_mtx_ext;
-	struct tsg_time		pps_time_ext;
-
-	struct pps_state	pps_state_pulse;
-	struct mtx		pps_mtx_pulse;
-	struct tsg_time		pps_time_pulse;
-
-	struct pps_state	pps_state_synth;
-	struct mtx		pps_mtx_synth;
-	struct tsg_time		pps_time_synth;
+	uint8_t		intmask_user;
+	uint8_t		intmask_wait;
+
+	// pending holds the TSG_INTR_* events captured by tsg_filter but not
+	// yet handled by tsg_ithrd. While it is non-zero the board time latched
+	// by the filter, and latch_cycles, must not be overwritten.
+	uint8_t		pending;
+	uint64_t	latch_cycles;	// cycle counter at the filter's latch
+
+	struct tsg_shadow	config;		// REG_CONFIG
+	struct tsg_shadow	misc_control;	// REG_MISC_CONTROL
+	struct tsg_shadow	synth_control;	// REG_SYNTH_CONTROL
+
+	// We manage four PPS API interfaces (SRC_*)
+	struct tsg_source	sources[NSOURCES];
+
+	// Bus transaction counts. reg_read and reg_write charge bus_acct,
+	// which is only changed with cfg_lock held: it points at the running ioctl's
+	// entry in cmd_stats, or at bus_other. The interrupt handlers charge
+	// their own accounts directly.
+	struct tsg_busacct	*bus_acct;
+	struct tsg_cmdstats	*cmd_stats;	// indexed like tsg_ioctls
+	struct tsg_busacct	bus_filter;
+	struct tsg_busacct	bus_ithrd;
+	struct tsg_busacct	bus_preset;
+	struct tsg_busacct	bus_watch;
+	struct tsg_busacct	bus_cmpq;
+	struct tsg_busacct	bus_other;
 };
 
+static void		tsg_add_sysctls(struct tsg_softc *);
+static void		tsg_bench_finish(void *, int);
+static bool		bench_running(struct tsg_softc *);
+static void		update_edge_grid(struct tsg_softc *);
+static void		cmp_run(struct tsg_softc *);
+static void		cmp_shutdown(struct tsg_softc *);
+static void		sched_fire(struct tsg_softc *);
+static void		watch_start(struct tsg_softc *);
+static bool		telemetry_cached(struct tsg_softc *, struct tsg_telemetry *);
+
 static d_open_t		tsg_open;
 static d_close_t	tsg_close;
+static d_read_t		tsg_read;
 static d_ioctl_t	tsg_ioctl;
+static d_poll_t		tsg_poll;
+static d_kqfilter_t	tsg_kqfilter;
 
-static d_open_t		tsg_compare_open;
-static d_close_t	tsg_compare_close;
-static d_ioctl_t	tsg_compare_ioctl;
-
-static d_open_t		tsg_ext_open;
-static d_close_t	tsg_ext_close;
-static d_ioctl_t	tsg_ext_ioctl;
-
-static d_open_t		tsg_pulse_open;
-static d_close_t	tsg_pulse_close;
-static d_ioctl_t	tsg_pulse_ioctl;
-
-static d_open_t		tsg_synth_open;
-static d_close_t	tsg_synth_close;
-static d_ioctl_t	tsg_synth_ioctl;
+static d_open_t		tsg_source_open;
+static d_close_t	tsg_source_close;
+static d_read_t		tsg_source_read;
+static d_ioctl_t	tsg_source_ioctl;
+static d_mmap_single_t	tsg_source_mmap_single;
+static d_poll_t		tsg_source_poll;
+static d_kqfilter_t	tsg_source_kqfilter;
 
 static struct cdevsw tsg_cdevsw = {
 	.d_version =	D_VERSION,
 	.d_open =	tsg_open,
 	.d_close =	tsg_close,
+	.d_read =	tsg_read,
 	.d_ioctl =	tsg_ioctl,
+	.d_poll =	tsg_poll,
+	.d_kqfilter =	tsg_kqfilter,
 	.d_name = 	"tsg"
 };
 
-static struct cdevsw tsg_cdevsw_compare = {
-	.d_version =	D_VERSION,
-	.d_open =	tsg_compare_open,
-	.d_close =	tsg_compare_close,
-	.d_ioctl =	tsg_compare_ioctl,
-	.d_name =	"tsg_compare"
+// per open file state for the main device
+struct tsg_open {
+	struct tsg_softc *sc;
+	uint32_t	preset_seen;	// last finished preset collected
+	struct ring_reader rd;		// of status_ring
 };
 
-static struct cdevsw tsg_cdevsw_ext = {
+// shared by the .compare, .ext, .pulse and .synth devices
+static struct cdevsw tsg_cdevsw_source = {
 	.d_version =	D_VERSION,
-	.d_open =	tsg_ext_open,
-	.d_close =	tsg_ext_close,
-	.d_ioctl =	tsg_ext_ioctl,
-	.d_name	= 	"tsg_ext"
+	.d_open =	tsg_source_open,
+	.d_close =	tsg_source_close,
+	.d_read =	tsg_source_read,
+	.d_ioctl =	tsg_source_ioctl,
+	.d_mmap_single = tsg_source_mmap_single,
+	.d_poll =	tsg_source_poll,
+	.d_kqfilter =	tsg_source_kqfilter,
+	.d_name =	"tsg_source"
 };
 
-static struct cdevsw tsg_cdevsw_pulse = {
-	.d_version =	D_VERSION,
-	.d_open =	tsg_pulse_open,
-	.d_close =	tsg_pulse_close,
-	.d_ioctl =	tsg_pulse_ioctl,
-	.d_name =	"tsg_pulse"
-};
+static devclass_t tsg_devclass;
 
-static struct cdevsw tsg_cdevsw_synth = {
-	.d_version =	D_VERSION,
-	.d_open =	tsg_synth_open,
-	.d_close =	tsg_synth_close,
-	.d_ioctl =	tsg_synth_ioctl,
-	.d_name =	"tsg_synth"
+static void
+lock(struct tsg_softc *sc)
+{
+	if (!sx_try_xlock(&sc->cfg_lock)) {
+		atomic_add_64(&sc->cfg_contended, 1);
+		sx_xlock(&sc->cfg_lock);
+	}
+}
+
+#define	unlock(sc)	sx_xunlock(&(sc)->cfg_lock)
+
+// Blocks of plain data registers that are read a word at a time. Reading
+// them has no side effect, so a 32 bit read returns what four byte reads
+// would: one PCI transaction through the PLX 9050 instead of four. The
+// control and status bytes, and every write, stay a byte at a time, since
+// which byte lands when matters there (writing 0xfc latches the time, and
+// the control registers have strobes).
+static const struct {
+	bus_size_t	start;
+	bus_size_t	end;
+} word_blocks[] = {
+	{ 0xfc, 0x108 },				// latched time
+	{ REG_POSITION, REG_POSITION + 0x10 },		// GPS position
+	{ 0x11c, REG_SYNTH_FREQ + 4 },			// test status to synth frequency
+	{ REG_TIME_COMPARE, REG_TIME_COMPARE + 8 },	// time compare
+	{ 0x198, 0x1b0 },				// GPS satellite table
 };
 
-static devclass_t tsg_devclass;
+static bool
+word_readable(bus_size_t off, bus_size_t len)
+{
+	int i;
+
+	for (i = 0; i < nitems(word_blocks); ++i)
+		if (off >= word_blocks[i].start && off + len <= word_blocks[i].end)
+			return true;
+	return false;
+}
+
+// Registers are little endian; buf holds them in board order. Only the
+// unaligned ends of a word readable range are read a byte at a time.
+static void
+reg_in(struct tsg_softc *sc, struct tsg_busacct *acct, bus_size_t off, uint8_t *buf, bus_size_t len)
+{
+	uint32_t words[8];
+	bus_size_t i, n;
+
+	if (!word_readable(off, len)) {
+		for (; len > 0; --len, ++acct->reads)
+			*buf++ = bus_read_1(sc->registers_resource, off++);
+		return;
+	}
+	for (; len > 0 && (off & 3) != 0; --len, ++acct->reads)
+		*buf++ = bus_read_1(sc->registers_resource, off++);
+	while (len >= 4) {
+		n = MIN(len / 4, nitems(words));
+		bus_read_region_4(sc->registers_resource, off, words, n);
+		for (i = 0; i < n; ++i, buf += 4)
+			le32enc(buf, words[i]);
+		off += n * 4;
+		len -= n * 4;
+		acct->reads += n;
+	}
+	for (; len > 0; --len, ++acct->reads)
+		*buf++ = bus_read_1(sc->registers_resource, off++);
+}
+
+static void
+reg_out(struct tsg_softc *sc, struct tsg_busacct *acct, bus_size_t off, const uint8_t *buf, bus_size_t len)
+{
+	for (; len > 0; --len, ++acct->writes)
+		bus_write_1(sc->registers_resource, off++, *buf++);
+}
+
+#define	reg_read(sc, off, buf, len)	reg_in((sc), (sc)->bus_acct, (off), (buf), (len))
+#define	reg_write(sc, off, buf, len)	reg_out((sc), (sc)->bus_acct, (off), (buf), (len))
+
+static void
+shadow_init(struct tsg_shadow *sh, bus_size_t reg, uint8_t strobes, uint8_t live)
+{
+	sh->reg = reg;
+	sh->strobes = strobes;
+	sh->live = live;
+	sh->valid = false;
+}
+
+// Return the bits in mask, only reading the board if some of them aren't cached.
+static uint8_t
+shadow_get(struct tsg_softc *sc, struct tsg_shadow *sh, uint8_t mask)
+{
+	uint8_t reg;
+
+	sx_assert(&sc->cfg_lock, SA_XLOCKED);
+	if (sh->valid && (mask & (sh->strobes | sh->live)) == 0)
+		return sh->value & mask;
+	reg_read(sc, sh->reg, &reg, 1);
+	sh->value = reg & ~(sh->strobes | sh->live);
+	sh->valid = true;
+	return reg & mask;
+}
+
+// Replace the bits in mask with bits. Strobes outside mask are written as 0,
+// and live bits outside mask are preserved, which costs a read.
+static void
+shadow_set(struct tsg_softc *sc, struct tsg_shadow *sh, uint8_t mask, uint8_t bits)
+{
+	uint8_t reg;
 
-#define	lock(sc)	mtx_lock(&(sc)->mtx)
-#define	unlock(sc)	mtx_unlock(&(sc)->mtx)
+	reg = shadow_get(sc, sh, ~(mask | sh->strobes)) | (bits & mask);
+	reg_write(sc, sh->reg, &reg, 1);
+	sh->value = reg & ~(sh->strobes | sh->live);
+}
 
 #include "pack.c"
+#include "layout.c"
+#include "bcdtime.c"
 #include "ushort2bcd.c"
 
 static char *
@@ -254,168 +582,429 @@ tsg_modevent(module_t mod __unused, int event, void *arg __unused)
 	return error;
 }
 
-static char *fmt_bcd_time = "nnnn nnnn nnnn";
+// 3 word reads; the hardware status and lock status registers come along
+static void
+read_bcd_time(struct tsg_softc *sc, struct tsg_busacct *acct, uint8_t *buf)
+{
+	reg_in(sc, acct, 0xfc, buf, bcd_time_len);
+}
+
+// Acquire latch_mtx, waiting for tsg_ithrd to collect any board time latched
+// by tsg_filter so we don't clobber it by latching again. The ithread can
+// block on the source, notify and compare mutexes before it clears pending,
+// so this sleeps until it does; only the ioctl handlers call it, and they
+// hold no mutex.
+static void
+latch_lock(struct tsg_softc *sc)
+{
+	mtx_lock_spin(&sc->latch_mtx);
+	if (sc->pending != 0)
+		sc->latch_waits++;
+	while (sc->pending != 0) {
+		sc->latch_sleepers++;
+		msleep_spin(&sc->pending, &sc->latch_mtx, "tsglat", 0);
+		sc->latch_sleepers--;
+	}
+}
+
+#define	latch_unlock(sc)	mtx_unlock_spin(&(sc)->latch_mtx)
 
 static void
-read_bcd_time(struct tsg_softc *sc)
+hist_add(uint64_t *hist, uint64_t cycles)
+{
+	hist[MIN(flsll(cycles), TSG_HIST_BUCKETS - 1)]++;
+}
+
+// Apply src's rate limit and decimation to an edge; return false if the
+// edge is to be dropped. A source over its rate is masked until someone
+// enables it again. TSG_WAIT_UNTIL sleepers need every compare, and
+// only get one each, so compares are always let through while they wait.
+static bool
+edge_admit(struct tsg_softc *sc, struct tsg_source *src, int i)
 {
-	bus_read_region_1(sc->registers_resource, 0xfc, sc->buf, packlen(fmt_bcd_time));
+	mtx_assert(&sc->latch_mtx, MA_OWNED);
+	if (sc->intmask_wait & src->enable)
+		return true;
+	if (ticks - src->rate_start >= hz) {
+		src->rate_start = ticks;
+		src->rate_count = 0;
+	}
+	if (++src->rate_count > src->max_rate) {
+		sc->intmask_user &= ~src->enable;
+		sc->intmask &= ~src->enable;
+		sc->intr_stats.throttled[i]++;
+		return false;
+	}
+	if (++src->edges < src->decimate)
+		return false;
+	src->edges = 0;
+	return true;
 }
 
-// bcd_time holds the BCD components of the time taken from the board
-struct bcd_time {
-	uint8_t thousands_year;
-	uint8_t hundreds_year;
-	uint8_t tens_year;
-	uint8_t units_year;
+// tsg_filter runs in primary interrupt context, so it only does the time
+// critical work: latch the board time, find out which events occurred, and
+// take the PPS timestamps. Everything else is left to tsg_ithrd.
+static int
+tsg_filter(void *arg)
+{
+	struct tsg_softc *sc = arg;
+	struct tsg_source *src;
+	uint64_t start = get_cyclecount();
+	uint8_t latch = 0;
+	uint8_t intstat;
+	uint8_t pending = 0;
+	uint8_t dropped = 0;
+	int i;
+
+	if (!mtx_trylock_spin(&sc->latch_mtx)) {
+		mtx_lock_spin(&sc->latch_mtx);
+		sc->latch_contended++;
+	}
+	sc->intr_stats.interrupts++;
+
+	// the ithread hasn't collected the previous latched time yet
+	if (sc->pending != 0) {
+		sc->intr_stats.deferred++;
+		hist_add(sc->intr_stats.filter_cycles, get_cyclecount() - start);
+		mtx_unlock_spin(&sc->latch_mtx);
+		return FILTER_SCHEDULE_THREAD;
+	}
+	sc->bus_filter.calls++;
 
-	uint8_t hundreds_day;
-	uint8_t tens_day;
-	uint8_t units_day;
+	// latch board time so the ithread can grab it later
+	sc->latch_cycles = get_cyclecount();
+	reg_out(sc, &sc->bus_filter, 0xfc, &latch, 1);
 
-	uint8_t tens_hour;
-	uint8_t units_hour;
+	// find out which events occurred
+	reg_in(sc, &sc->bus_filter, REG_HARDWARE_STATUS, &intstat, 1);
 
-	uint8_t tens_min;
-	uint8_t units_min;
+	// capture PPS events when we are interested in them AND they have occurred
+	for (i = 0; i < NSOURCES; ++i) {
+		src = &sc->sources[i];
+		if ((sc->intmask & src->enable) == 0 || (intstat & src->intr) == 0)
+			continue;
+		if (!edge_admit(sc, src, i)) {
+			dropped |= src->clear;
+			continue;
+		}
+		pps_capture(&src->pps_state);
+		pending |= src->intr;
+		sc->intr_stats.events[i]++;
+	}
 
-	uint8_t tens_sec;
-	uint8_t units_sec;
+	// acknowledge dropped edges here, along with any source just masked
+	if (dropped != 0) {
+		dropped |= sc->intmask;
+		reg_out(sc, &sc->bus_filter, REG_HARDWARE_CONTROL, &dropped, 1);
+	}
 
-	uint8_t hundreds_milli;
-	uint8_t tens_milli;
-	uint8_t units_milli;
+	// the IRQ is shared, so this may well be someone else's interrupt
+	if (pending == 0 && dropped == 0)
+		sc->intr_stats.stray++;
+	sc->pending = pending;
+	hist_add(sc->intr_stats.filter_cycles, get_cyclecount() - start);
+	mtx_unlock_spin(&sc->latch_mtx);
 
-	uint8_t	hundreds_micro;
-	uint8_t tens_micro;
-	uint8_t units_micro;
+	if (pending != 0)
+		return FILTER_SCHEDULE_THREAD;
+	return dropped != 0 ? FILTER_HANDLED : FILTER_STRAY;
+}
 
-	uint8_t hundreds_nano;
-};
+static uint8_t
+decode_clock_lock(uint8_t reg)
+{
+	/* lock status is upper nibble of lock status register */
+	return (reg >> 4) & (TSG_CLOCK_PHASE_LOCK|TSG_CLOCK_INPUT_VALID|TSG_CLOCK_GPS_LOCK);
+}
 
 static void
-unpack_bcd_time(uint8_t *buf, struct bcd_time *b)
-{
-	unpack(
-		buf,
-		fmt_bcd_time,
-		&b->tens_micro,		&b->units_micro,
-		&b->units_milli,	&b->hundreds_micro,
-		NULL,			NULL,
-		&b->hundreds_nano,	NULL,
-		&b->hundreds_milli,	&b->tens_milli,
-		&b->tens_sec,		&b->units_sec,
-		&b->tens_min,		&b->units_min,
-		&b->tens_hour,		&b->units_hour,
-		&b->tens_day,		&b->units_day,
-		NULL,			&b->hundreds_day,
-		&b->tens_year,		&b->units_year,
-		&b->thousands_year,	&b->hundreds_year
-	);
+decode_timecode_quality(uint8_t buf, struct tsg_timecode_quality *q)
+{
+	unpack(&buf, "n", &q->level, &q->locked);
+	q->locked &= TSG_QUALITY_NOT_LOCKED;		// clear unrelated bits
+	q->locked |= ~TSG_QUALITY_NOT_LOCKED;		// flip not locked bit
+	switch (q->level) {
+	case 0x01:
+		q->level = 1;
+		break;
+	case 0x02:
+		q->level = 2;
+		break;
+	case 0x04:
+		q->level = 3;
+		break;
+	case 0x08:
+		q->level = 4;
+		break;
+	default:
+		q->level = 0;
+		break;
+	}
 }
 
+// Snapshot the clock status so event records show the state of the board
+// when the event happened, not when userland got around to asking.
+// bcd is the latched time read by read_bcd_time, which already holds the
+// lock status register.
 static void
-bcd2time(struct bcd_time *b, struct tsg_time *t, int new)
+read_event_status(struct tsg_softc *sc, uint8_t *bcd, struct tsg_event *ev)
 {
-	t->year = b->thousands_year * 1000 +
-		  b->hundreds_year * 100 +
-		  b->tens_year * 10 +
-		  b->units_year;
+	uint8_t reg;
 
-	t->day = b->hundreds_day * 100 +
-		 b->tens_day * 10 +
-		 b->units_day;
+	ev->lock = decode_clock_lock(bcd[REG_LOCK_STATUS - 0xfc]);
 
-	t->hour = b->tens_hour * 10 + b->units_hour;
+	reg_in(sc, &sc->bus_ithrd, REG_CONFIG, &reg, 1);
+	ev->ref = reg & TSG_CLOCK_REF_MASK;
 
-	t->min = b->tens_min * 10 + b->units_min;
+	/* only new boards have a timecode quality register */
+	if (sc->new_model) {
+		reg_in(sc, &sc->bus_ithrd, REG_TIMECODE_QUALITY, &reg, 1);
+		decode_timecode_quality(reg, &ev->quality);
+	} else
+		ev->quality.locked = ev->quality.level = 0;
+}
 
-	t->sec = b->tens_sec * 10 + b->units_sec;
+// Update the mmap(2) page. seq is odd while the event is being written, so
+// readers can tell when they need to retry. There is only ever one writer
+// per page because the source mutex is held.
+static void
+publish_event(struct tsg_event_page *pg, struct tsg_event *ev)
+{
+	uint32_t seq = pg->seq;
 
-	t->nsec = b->hundreds_milli * 100000000 +
-		  b->tens_milli  *     10000000 +
-		  b->units_milli *      1000000 +
-		  b->hundreds_micro *    100000 +
-		  b->tens_micro *         10000 +
-		  b->units_micro *         1000;
+	pg->seq = seq + 1;
+	atomic_thread_fence_rel();
+	pg->event = *ev;
+	atomic_store_rel_32(&pg->seq, seq + 2);
+}
 
-	if (new)
-		t->nsec += b->hundreds_nano * 100;
+static void
+set_timespec(struct tsg_timespec *t, const struct timespec *ts)
+{
+	t->sec = ts->tv_sec;
+	t->nsec = ts->tv_nsec;
+	t->pad = 0;
 }
 
+// finish the PPS event captured by tsg_filter and record it
 static void
-timestamp(struct pps_state *state, struct mtx *mtx)
+timestamp(struct tsg_source *src, struct tsg_event *ev)
 {
-	mtx_lock(mtx);
-	pps_capture(state);
-	pps_event(state, PPS_CAPTUREASSERT);
-	mtx_unlock(mtx);
+	mtx_lock(&src->mtx);
+	pps_event(&src->pps_state, PPS_CAPTUREASSERT);
+	src->time = ev->time;
+	src->cycles = ev->cycles;
+
+	ev->sequence = src->pps_state.ppsinfo.assert_sequence;
+	set_timespec(&ev->timestamp, &src->pps_state.ppsinfo.assert_timestamp);
+	ring_put(&src->ring, ev);
+	publish_event(src->page, ev);
+	mtx_unlock(&src->mtx);
 }
 
+// step t back one second
 static void
-tsg_ithrd(void *arg)
+time_prev_sec(struct tsg_time *t)
 {
-	struct tsg_softc *sc = arg;
-	uint8_t intstat;
-	unsigned intmask;
-	uint8_t clearmask = 0;
+	if (t->sec > 0) {
+		t->sec--;
+		return;
+	}
+	t->sec = 59;
+	if (t->min > 0) {
+		t->min--;
+		return;
+	}
+	t->min = 59;
+	if (t->hour > 0) {
+		t->hour--;
+		return;
+	}
+	t->hour = 23;
+	if (t->day > 1) {
+		t->day--;
+		return;
+	}
+	t->year--;
+	t->day = (t->year % 4 == 0 && (t->year % 100 != 0 || t->year % 400 == 0)) ? 366 : 365;
+}
 
-	lock(sc);
+// step t forward usec microseconds
+static void
+time_add_usec(struct tsg_time *t, uint64_t usec)
+{
+	uint64_t nsec = t->nsec + usec % 1000000 * 1000;
+	uint64_t secs = usec / 1000000 + nsec / 1000000000;
+	uint64_t day;
+	uint16_t days;
+
+	t->nsec = nsec % 1000000000;
+	secs += t->sec + 60 * (t->min + 60 * t->hour);
+	t->sec = secs % 60;
+	t->min = secs / 60 % 60;
+	t->hour = secs / 3600 % 24;
+	day = t->day + secs / 86400;
+	for (;;) {
+		days = (t->year % 4 == 0 && (t->year % 100 != 0 || t->year % 400 == 0)) ? 366 : 365;
+		if (day <= days)
+			break;
+		day -= days;
+		t->year++;
+	}
+	t->day = day;
+}
+
+// Find the edge on src's grid that ev->time follows. The latency is less
+// than a period unless interrupts were held off for that long.
+static void
+edge_time(struct tsg_source *src, struct tsg_event *ev)
+{
+	uint32_t period = src->period;
+	uint32_t since;
 
-	// latch board time so we can grab it later
-	bus_write_region_1(sc->registers_resource, 0xfc, sc->buf, 1);
+	ev->edge = ev->time;
+	if (period == 0) {
+		ev->flags = 0;
+		ev->latency = 0;
+		return;
+	}
+	since = (ev->time.nsec + period - src->phase) % period;
+	if (since > ev->edge.nsec) {
+		time_prev_sec(&ev->edge);
+		ev->edge.nsec += 1000000000;
+	}
+	ev->edge.nsec -= since;
+	ev->latency = since;
+	ev->flags = TSG_EVENT_EDGE;
+}
 
-	// find out which events occurred
-	bus_read_region_1(sc->registers_resource, REG_HARDWARE_STATUS, &intstat, 1);
+// add a pulse interrupt's latency to the running benchmark
+static void
+bench_sample(struct tsg_softc *sc, uint32_t ns)
+{
+	mtx_lock(&sc->notify_mtx);
+	if (sc->bench_state == TSG_BENCH_RUNNING) {
+		sc->bench_hist[MIN(ns / TSG_BENCH_BIN_NS, TSG_BENCH_BINS - 1)]++;
+		sc->bench_samples++;
+		sc->bench_min = MIN(sc->bench_min, ns);
+		sc->bench_max = MAX(sc->bench_max, ns);
+	}
+	mtx_unlock(&sc->notify_mtx);
+}
 
-	// which events are we interested in?
-	intmask = sc->intmask;
+static void
+tsg_ithrd(void *arg)
+{
+	struct tsg_softc *sc = arg;
+	struct tsg_source *src;
+	uint64_t start = get_cyclecount();
+	uint8_t buf[sizeof(sc->buf)];
+	uint8_t pending;
+	uint8_t clearmask = 0;
+	struct tsg_event ev;
+	bool wake;
+	int i;
 
-	// capture PPS events when we are interested in them AND they have occurred
-	if ((intmask & TSG_INT_ENABLE_EXT) && (intstat & TSG_INTR_EXT)) {
-		timestamp(&sc->pps_state_ext, &sc->pps_mtx_ext);
-		clearmask |= TSG_CLEAR_EXT;
-	}
-	if ((intmask & TSG_INT_ENABLE_PULSE) && (intstat & TSG_INTR_PULSE)) {
-		timestamp(&sc->pps_state_pulse, &sc->pps_mtx_pulse);
-		clearmask |= TSG_CLEAR_PULSE;
-	}
-	if ((intmask & TSG_INT_ENABLE_COMPARE) && (intstat & TSG_INTR_COMPARE)) {
-		timestamp(&sc->pps_state_compare, &sc->pps_mtx_compare);
-		clearmask |= TSG_CLEAR_COMPARE;
-	}
-	if ((intmask & TSG_INT_ENABLE_SYNTH) && (intstat & TSG_INTR_SYNTH)) {
-		timestamp(&sc->pps_state_synth, &sc->pps_mtx_synth);
-		clearmask |= TSG_CLEAR_SYNTH;
-	}
-
-	// save latched time for userland
-	struct bcd_time b;
-	struct tsg_time latched_time;
-
-	read_bcd_time(sc);
-	unpack_bcd_time(sc->buf, &b);
-	bcd2time(&b, &latched_time, sc->new_model);
-	if (clearmask & TSG_CLEAR_EXT)
-		sc->pps_time_ext = latched_time;
-	if (clearmask & TSG_CLEAR_PULSE)
-		sc->pps_time_pulse = latched_time;
-	if (clearmask & TSG_CLEAR_COMPARE)
-		sc->pps_time_compare = latched_time;
-	if (clearmask & TSG_CLEAR_SYNTH)
-		sc->pps_time_synth = latched_time;
+	// the record goes to userland whole, padding included
+	memset(&ev, 0, sizeof(ev));
+
+	// collect the board time latched by tsg_filter
+	mtx_lock_spin(&sc->latch_mtx);
+	pending = sc->pending;
+	if (pending != 0) {
+		read_bcd_time(sc, &sc->bus_ithrd, buf);
+		ev.cycles = sc->latch_cycles;
+	}
+	mtx_unlock_spin(&sc->latch_mtx);
+
+	if (pending == 0)
+		return;
+	sc->bus_ithrd.calls++;
+
+	bcdtime_decode(buf, sc->new_model, &ev.time);
+	read_event_status(sc, buf, &ev);
+
+	// finish the PPS events and save latched time for userland
+	for (i = 0; i < NSOURCES; ++i) {
+		src = &sc->sources[i];
+		if (pending & src->intr) {
+			edge_time(src, &ev);
+			if (i == SRC_PULSE && ev.flags & TSG_EVENT_EDGE)
+				bench_sample(sc, ev.latency);
+			timestamp(src, &ev);
+			clearmask |= src->clear;
+		}
+	}
 
 	// the control register holds the events we are interested in, and is used
 	// to clear/acknowlege events
+	mtx_lock_spin(&sc->latch_mtx);
 	clearmask |= sc->intmask;
-	bus_write_region_1(sc->registers_resource, REG_HARDWARE_CONTROL, &clearmask, 1);
+	reg_out(sc, &sc->bus_ithrd, REG_HARDWARE_CONTROL, &clearmask, 1);
+	sc->pending = 0;
+	wake = sc->latch_sleepers != 0;
+	hist_add(sc->intr_stats.ithrd_cycles, get_cyclecount() - start);
+	mtx_unlock_spin(&sc->latch_mtx);
+	if (wake)
+		wakeup(&sc->pending);
+
+	// wake any sleepers that are due and arm the compare for the next;
+	// this needs a fresh latch, so it can't be done before pending is clear
+	if ((pending & TSG_INTR_COMPARE) || sc->cmp_rerun) {
+		mtx_lock(&sc->cmp_mtx);
+		cmp_run(sc);
+		mtx_unlock(&sc->cmp_mtx);
+	}
+}
 
-	unlock(sc);
+// The latest event page is the only page of a VM object, which each
+// mapping of it holds a reference to, so it outlives the softc for
+// processes that still have it mapped. The driver writes it through a
+// kernel mapping of its own.
+static void
+event_page_alloc(struct tsg_source *src)
+{
+	vm_page_t m;
+
+	src->page_obj = vm_pager_allocate(OBJT_PHYS, NULL, PAGE_SIZE, VM_PROT_READ, 0, NULL);
+	VM_OBJECT_WLOCK(src->page_obj);
+	m = vm_page_grab(src->page_obj, 0, VM_ALLOC_WIRED | VM_ALLOC_ZERO);
+	vm_page_valid(m);
+	vm_page_xunbusy(m);
+	VM_OBJECT_WUNLOCK(src->page_obj);
+
+	src->page_m = m;
+	src->page = (struct tsg_event_page *)kva_alloc(PAGE_SIZE);
+	pmap_qenter((vm_offset_t)src->page, &m, 1);
+}
+
+// Drop the driver's hold on the page; the object frees it once the last
+// mapping goes. Readers still mapping it see the last event for good.
+static void
+event_page_free(struct tsg_source *src)
+{
+	if (src->page_obj == NULL)
+		return;
+	pmap_qremove((vm_offset_t)src->page, 1);
+	kva_free((vm_offset_t)src->page, PAGE_SIZE);
+	src->page = NULL;
+
+	VM_OBJECT_WLOCK(src->page_obj);
+	vm_page_unwire_noq(src->page_m);
+	VM_OBJECT_WUNLOCK(src->page_obj);
+	src->page_m = NULL;
+	vm_object_deallocate(src->page_obj);
+	src->page_obj = NULL;
 }
 
 static void
 release_resources(struct tsg_softc *sc)
 {
+	int i;
+
+	callout_drain(&sc->preset_callout);
+	callout_drain(&sc->watch_callout);
+	taskqueue_drain_timeout(taskqueue_thread, &sc->bench_task);
 	tsg_intcsr(sc, 0);
 
 	if (sc->cookiep != NULL) {
@@ -455,20 +1044,54 @@ release_resources(struct tsg_softc *sc)
 		sc->registers_resource = NULL;
 	}
 
-	mtx_destroy(&sc->pps_mtx_compare);
-	mtx_destroy(&sc->pps_mtx_ext);
-	mtx_destroy(&sc->pps_mtx_pulse);
-	mtx_destroy(&sc->pps_mtx_synth);
-	mtx_destroy(&sc->mtx);
+	for (i = 0; i < NSOURCES; ++i) {
+		ring_destroy(&sc->sources[i].ring);
+		event_page_free(&sc->sources[i]);
+		mtx_destroy(&sc->sources[i].mtx);
+	}
+	free(sc->cmd_stats, M_DEVBUF);
+	free(sc->bench_hist, M_DEVBUF);
+	free(sc->sched_times, M_DEVBUF);
+	ring_destroy(&sc->status_ring);
+	ring_destroy(&sc->telemetry_ring);
+	seldrain(&sc->main_sel);
+	knlist_clear(&sc->main_sel.si_note, 0);
+	knlist_destroy(&sc->main_sel.si_note);
+	mtx_destroy(&sc->notify_mtx);
+	mtx_destroy(&sc->cmp_mtx);
+	mtx_destroy(&sc->latch_mtx);
+	sx_destroy(&sc->cfg_lock);
 }
 
 static void
-setup_pps_state(struct pps_state *state, struct mtx *mtx)
+setup_source(struct tsg_softc *sc, int i, char *name, uint8_t enable, uint8_t intr, uint8_t clear)
 {
-	state->ppscap = PPS_CAPTUREASSERT;
-	state->driver_abi = PPS_ABI_VERSION;
-	state->driver_mtx = mtx;
-	pps_init_abi(state);
+	struct tsg_source *src = &sc->sources[i];
+
+	src->name = name;
+	src->enable = enable;
+	src->intr = intr;
+	src->clear = clear;
+	src->cdev = NULL;
+	src->decimate = 1;
+	src->edges = 0;
+	src->max_rate = TSG_RATE_DEFAULT;
+	src->rate_count = 0;
+	src->rate_start = ticks;
+
+	mtx_init(&src->mtx, name, NULL, MTX_DEF);
+	ring_init(&src->ring, &src->mtx, sizeof(struct tsg_event), EVENT_RING_SIZE);
+
+	event_page_alloc(src);
+
+	src->pps_state.ppscap = PPS_CAPTUREASSERT;
+	src->pps_state.driver_abi = PPS_ABI_VERSION;
+	src->pps_state.driver_mtx = &src->mtx;
+	pps_init_abi(&src->pps_state);
+
+	// capture asserts even if nobody has set PPS API params, so the
+	// event records have timestamps
+	src->pps_state.ppsparam.mode = PPS_CAPTUREASSERT | PPS_TSFMT_TSPEC;
 }
 
 static int
@@ -479,12 +1102,37 @@ tsg_attach(device_t dev)
 	sc->device = dev;
 	sc->lcr_resource = NULL;
 	sc->registers_resource = NULL;
-
-	mtx_init(&sc->mtx, "tsg", NULL, MTX_DEF);
-	mtx_init(&sc->pps_mtx_compare, "tsg_compare", NULL, MTX_DEF);
-	mtx_init(&sc->pps_mtx_ext, "tsg_ext", NULL, MTX_DEF);
-	mtx_init(&sc->pps_mtx_pulse, "tsg_pulse", NULL, MTX_DEF);
-	mtx_init(&sc->pps_mtx_synth, "tsg_synth", NULL, MTX_DEF);
+	sc->bus_acct = &sc->bus_other;
+
+	sx_init(&sc->cfg_lock, "tsg");
+	mtx_init(&sc->notify_mtx, "tsg_notify", NULL, MTX_DEF);
+	knlist_init_mtx(&sc->main_sel.si_note, &sc->notify_mtx);
+	callout_init_mtx(&sc->preset_callout, &sc->notify_mtx, 0);
+	callout_init_mtx(&sc->watch_callout, &sc->notify_mtx, 0);
+	ring_init(&sc->status_ring, &sc->notify_mtx, sizeof(struct tsg_status_change), STATUS_RING_SIZE);
+	ring_init(&sc->telemetry_ring, &sc->notify_mtx, sizeof(struct tsg_telemetry), TSG_TELEMETRY_HISTORY);
+	sc->watch_ms = TSG_WATCH_DEFAULT_MS;
+	sc->watch_valid = false;
+	sc->watch_seq = 0;
+	memset(&sc->telemetry, 0, sizeof(sc->telemetry));
+	TIMEOUT_TASK_INIT(taskqueue_thread, &sc->bench_task, 0, tsg_bench_finish, sc);
+	sc->bench_hist = malloc(TSG_BENCH_BINS * sizeof(*sc->bench_hist), M_DEVBUF, M_WAITOK | M_ZERO);
+	mtx_init(&sc->latch_mtx, "tsg_latch", NULL, MTX_SPIN);
+	mtx_init(&sc->cmp_mtx, "tsg_cmp", NULL, MTX_DEF);
+	cmpq_init(&sc->cmpq);
+	sc->cmp_rerun = false;
+	sc->cmp_gone = false;
+	sc->cmp_time = 0;
+	sc->sched_w.slot = -1;
+	sc->sched_state = TSG_SCHEDULE_IDLE;
+	sc->sched_times = NULL;
+	sc->sched_count = sc->sched_period = sc->sched_left = 0;
+	sc->sched_forever = false;
+	sc->sched_fired = sc->sched_missed = 0;
+	setup_source(sc, SRC_COMPARE, "compare", TSG_INT_ENABLE_COMPARE, TSG_INTR_COMPARE, TSG_CLEAR_COMPARE);
+	setup_source(sc, SRC_EXT, "ext", TSG_INT_ENABLE_EXT, TSG_INTR_EXT, TSG_CLEAR_EXT);
+	setup_source(sc, SRC_PULSE, "pulse", TSG_INT_ENABLE_PULSE, TSG_INTR_PULSE, TSG_CLEAR_PULSE);
+	setup_source(sc, SRC_SYNTH, "synth", TSG_INT_ENABLE_SYNTH, TSG_INTR_SYNTH, TSG_CLEAR_SYNTH);
 
 	/* arrange to talk to LCR */
 	sc->lcr_rid = PCIR_BAR(BAR_LCR);
@@ -518,17 +1166,24 @@ tsg_attach(device_t dev)
 	sc->new_model = sc->model == TSG_MODEL_PCI_SG_2U || sc->model == TSG_MODEL_GPS_PCI_2U;
 	sc->has_gps = sc->model == TSG_MODEL_GPS_PCI || sc->model == TSG_MODEL_GPS_PCI_2U;
 
+	// The board clears the preset, DAC save and synth load bits when done,
+	// and may clear the leap bit once the leap second has passed.
+	// Nothing else in these registers changes unless we write it.
+	shadow_init(&sc->config, REG_CONFIG, TSG_PRESET_TIME_READY | TSG_PRESET_POS_READY, 0);
+	shadow_init(&sc->misc_control, REG_MISC_CONTROL, TSG_SAVE_DAC, TSG_INSERT_LEAP);
+	shadow_init(&sc->synth_control, REG_SYNTH_CONTROL, TSG_SYNTH_LOAD, 0);
+	lock(sc);
+	update_edge_grid(sc);
+	unlock(sc);
+
 	/* turn off board interrupts */
 	tsg_intcsr(sc, 0);
 
 	/* clear interrupt mask on board */
-	sc->intmask = 0;
-	bus_write_region_1(sc->registers_resource, REG_HARDWARE_CONTROL, &sc->intmask, 1);
-
-	setup_pps_state(&sc->pps_state_compare, &sc->pps_mtx_compare);
-	setup_pps_state(&sc->pps_state_ext, &sc->pps_mtx_ext);
-	setup_pps_state(&sc->pps_state_pulse, &sc->pps_mtx_pulse);
-	setup_pps_state(&sc->pps_state_synth, &sc->pps_mtx_synth);
+	sc->intmask = sc->intmask_user = sc->intmask_wait = 0;
+	sc->pending = 0;
+	sc->latch_sleepers = 0;
+	reg_write(sc, REG_HARDWARE_CONTROL, &sc->intmask, 1);
 
 	/* allocate interrupt */
 	sc->intr_rid = 0;
@@ -550,7 +1205,7 @@ tsg_attach(device_t dev)
 		dev,
 		sc->intr_resource,
 		INTR_TYPE_CLK | INTR_MPSAFE,
-		NULL,
+		tsg_filter,
 		tsg_ithrd,
 		sc,
 		&sc->cookiep
@@ -561,6 +1216,12 @@ tsg_attach(device_t dev)
 		return err;
 	}
 
+	mtx_lock(&sc->notify_mtx);
+	watch_start(sc);
+	mtx_unlock(&sc->notify_mtx);
+
+	tsg_add_sysctls(sc);
+
 	int unit = device_get_unit(dev);
 	struct make_dev_args args;
 
@@ -579,41 +1240,19 @@ tsg_attach(device_t dev)
 		return ENXIO;
 	}
 
-	args.mda_devsw = &tsg_cdevsw_compare;
-	error = make_dev_s(&args, &sc->cdev_compare, "tsg%d.compare", unit);
-	if (error != 0) {
-		sc->cdev_compare = NULL;
-		release_resources(sc);
-		device_printf(dev, "cannot create device node tsg%d.compare", unit);
-		return ENXIO;
-	}
-
-	args.mda_devsw = &tsg_cdevsw_ext;
-	error = make_dev_s(&args, &sc->cdev_ext, "tsg%d.ext", unit);
-	if (error != 0) {
-		sc->cdev_ext = NULL;
-		release_resources(sc);
-		device_printf(dev, "cannot create device node tsg%d.ext", unit);
-		return ENXIO;
-	}
-
-	args.mda_devsw = &tsg_cdevsw_pulse;
-	error = make_dev_s(&args, &sc->cdev_pulse, "tsg%d.pulse", unit);
-	if (error != 0) {
-		sc->cdev_pulse = NULL;
-		release_resources(sc);
-		device_printf(dev, "cannot create device node tsg%d.pulse", unit);
-		return ENXIO;
-	}
+	args.mda_devsw = &tsg_cdevsw_source;
+	for (int i = 0; i < NSOURCES; ++i) {
+		struct tsg_source *src = &sc->sources[i];
 
-	sc->cdev_synth = NULL;
-	if (sc->new_model) {
-		args.mda_devsw = &tsg_cdevsw_synth;
-		error = make_dev_s(&args, &sc->cdev_synth, "tsg%d.synth", unit);
+		// only the new boards have a synthesizer
+		if (i == SRC_SYNTH && !sc->new_model)
+			continue;
+		args.mda_si_drv2 = src;
+		error = make_dev_s(&args, &src->cdev, "tsg%d.%s", unit, src->name);
 		if (error != 0) {
-			sc->cdev_synth = NULL;
+			src->cdev = NULL;
 			release_resources(sc);
-			device_printf(dev, "cannot create device node tsg%d.synth", unit);
+			device_printf(dev, "cannot create device node tsg%d.%s", unit, src->name);
 			return ENXIO;
 		}
 	}
@@ -627,7 +1266,7 @@ tsg_attach(device_t dev)
 		sc->major = sc->minor = sc->test = 0;
 	else {
 		char *fmt = "ccc";
-		bus_read_region_1(sc->registers_resource, 0x1bc, sc->buf, packlen(fmt));
+		reg_read(sc, 0x1bc, sc->buf, packlen(fmt));
 		unpack(sc->buf, fmt, &sc->major, &sc->minor, &sc->test);
 		device_printf(sc->device, "firmware: %d.%d.%d\n", sc->major, sc->minor, sc->test);
 	}
@@ -639,51 +1278,168 @@ static int
 tsg_detach(device_t dev)
 {
 	struct tsg_softc *sc = device_get_softc(dev);
+	struct tsg_source *src;
+	int i;
 
-	if (sc->cdev_synth)
-		destroy_dev(sc->cdev_synth);
-	if (sc->cdev_pulse)
-		destroy_dev(sc->cdev_pulse);
-	if (sc->cdev_ext)
-		destroy_dev(sc->cdev_ext);
-	if (sc->cdev_compare)
-		destroy_dev(sc->cdev_compare);
-	if (sc->cdev)
+	for (i = 0; i < NSOURCES; ++i) {
+		src = &sc->sources[i];
+		if (src->cdev) {
+			ring_shutdown(&src->ring);	// kick out blocked readers
+			destroy_dev(src->cdev);
+		}
+	}
+	if (sc->cdev) {
+		cmp_shutdown(sc);		// and sleepers in TSG_WAIT_UNTIL
+		ring_shutdown(&sc->status_ring);
 		destroy_dev(sc->cdev);
+	}
+
+	// no ioctl can start a benchmark now; stop one that is running and
+	// put back the pulse frequency and interrupt mask it changed
+	taskqueue_drain_timeout(taskqueue_thread, &sc->bench_task);
+	if (bench_running(sc))
+		tsg_bench_finish(sc, 0);
+
 	release_resources(sc);
 	return 0;
 }
 
+static void
+tsg_dtor(void *data)
+{
+	free(data, M_DEVBUF);
+}
+
+// Every open file collects preset completions and status changes for
+// itself, so new opens don't see old ones.
 static int
 tsg_open(struct cdev *dev, int oflags, int devtype, struct thread *td)
 {
-	//struct tsg_softc *sc = dev->si_drv1;
+	struct tsg_softc *sc = dev->si_drv1;
+	struct tsg_open *op;
+	int error;
+
+	op = malloc(sizeof(*op), M_DEVBUF, M_WAITOK);
+	op->sc = sc;
+	ring_reader_init(&sc->status_ring, &op->rd);
+	mtx_lock(&sc->notify_mtx);
+	op->preset_seen = sc->preset_done;
+	mtx_unlock(&sc->notify_mtx);
+	error = devfs_set_cdevpriv(op, tsg_dtor);
+	if (error != 0)
+		free(op, M_DEVBUF);
+	return error;
+}
 
-	return 0;
+// read(2) status change records
+static int
+tsg_read(struct cdev *dev, struct uio *uio, int ioflag)
+{
+	struct tsg_softc *sc = dev->si_drv1;
+	struct tsg_open *op;
+	int error;
+
+	if ((error = devfs_get_cdevpriv((void **)&op)) != 0)
+		return error;
+	return ring_read(&sc->status_ring, &op->rd, uio, ioflag);
+}
+
+// main device readiness: a preset this open hasn't collected has finished,
+// or there are status changes to read
+static bool
+tsg_ready(struct tsg_softc *sc, struct tsg_open *op)
+{
+	mtx_assert(&sc->notify_mtx, MA_OWNED);
+	return sc->preset_done != op->preset_seen ||
+	    ring_avail(&sc->status_ring, &op->rd) > 0 || sc->status_ring.gone;
 }
 
 static int
-tsg_compare_open(struct cdev *dev, int oflags, int devtype, struct thread *td)
+tsg_poll(struct cdev *dev, int events, struct thread *td)
 {
-	return 0;
+	struct tsg_softc *sc = dev->si_drv1;
+	struct tsg_open *op;
+	int revents = 0;
+
+	if (devfs_get_cdevpriv((void **)&op) != 0)
+		return events & (POLLIN | POLLRDNORM) ? POLLERR : 0;
+	if ((events & (POLLIN | POLLRDNORM)) == 0)
+		return 0;
+	mtx_lock(&sc->notify_mtx);
+	if (tsg_ready(sc, op))
+		revents = events & (POLLIN | POLLRDNORM);
+	else
+		selrecord(td, &sc->main_sel);
+	mtx_unlock(&sc->notify_mtx);
+	return revents;
 }
 
 static int
-tsg_ext_open(struct cdev *dev, int oflags, int devtype, struct thread *td)
+tsg_kqread(struct knote *kn, long hint)
 {
-	return 0;
+	struct tsg_open *op = kn->kn_hook;
+
+	// kn_data is the number of status changes to read
+	kn->kn_data = 0;
+	if (!tsg_ready(op->sc, op))
+		return 0;
+	kn->kn_data = ring_avail(&op->sc->status_ring, &op->rd);
+	if (op->sc->status_ring.gone)
+		kn->kn_flags |= EV_EOF;
+	return 1;
+}
+
+static void
+tsg_kqdetach(struct knote *kn)
+{
+	struct tsg_open *op = kn->kn_hook;
+
+	knlist_remove(&op->sc->main_sel.si_note, kn, 0);
 }
 
+static struct filterops tsg_read_filterops = {
+	.f_isfd = 1,
+	.f_detach = tsg_kqdetach,
+	.f_event = tsg_kqread,
+};
+
 static int
-tsg_pulse_open(struct cdev *dev, int oflags, int devtype, struct thread *td)
+tsg_kqfilter(struct cdev *dev, struct knote *kn)
 {
+	struct tsg_softc *sc = dev->si_drv1;
+	struct tsg_open *op;
+	int error;
+
+	if ((error = devfs_get_cdevpriv((void **)&op)) != 0)
+		return error;
+	if (kn->kn_filter != EVFILT_READ)
+		return EINVAL;
+	kn->kn_fop = &tsg_read_filterops;
+	kn->kn_hook = op;
+	knlist_add(&sc->main_sel.si_note, kn, 0);
 	return 0;
 }
 
+static void
+tsg_source_dtor(void *data)
+{
+	free(data, M_DEVBUF);
+}
+
+// Every open file gets its own ring reader, so each reader sees every event.
 static int
-tsg_synth_open(struct cdev *dev, int oflags, int devtype, struct thread *td)
+tsg_source_open(struct cdev *dev, int oflags, int devtype, struct thread *td)
 {
-	return 0;
+	struct tsg_source *src = dev->si_drv2;
+	struct ring_reader *rd;
+	int error;
+
+	rd = malloc(sizeof(*rd), M_DEVBUF, M_WAITOK);
+	ring_reader_init(&src->ring, rd);
+	error = devfs_set_cdevpriv(rd, tsg_source_dtor);
+	if (error != 0)
+		free(rd, M_DEVBUF);
+	return error;
 }
 
 static int
@@ -695,27 +1451,62 @@ tsg_close(struct cdev *dev, int fflag, int devtype, struct thread *td)
 }
 
 static int
-tsg_compare_close(struct cdev *dev, int fflag, int devtype, struct thread *td)
+tsg_source_close(struct cdev *dev, int fflag, int devtype, struct thread *td)
 {
 	return 0;
 }
 
+// The only thing to map is the page holding the latest event, read only.
+// The mapping takes its own reference to the page's object.
 static int
-tsg_ext_close(struct cdev *dev, int fflag, int devtype, struct thread *td)
+tsg_source_mmap_single(struct cdev *dev, vm_ooffset_t *offset, vm_size_t size, struct vm_object **object, int nprot)
 {
+	struct tsg_source *src = dev->si_drv2;
+
+	if (*offset < 0 || *offset + size > PAGE_SIZE)
+		return EINVAL;
+	if (nprot & PROT_WRITE)
+		return EACCES;
+	vm_object_reference(src->page_obj);
+	*object = src->page_obj;
 	return 0;
 }
 
+// read(2) returns whole struct tsg_events
 static int
-tsg_pulse_close(struct cdev *dev, int fflag, int devtype, struct thread *td)
+tsg_source_read(struct cdev *dev, struct uio *uio, int ioflag)
 {
-	return 0;
+	struct tsg_source *src = dev->si_drv2;
+	struct ring_reader *rd;
+	int error;
+
+	if ((error = devfs_get_cdevpriv((void **)&rd)) != 0)
+		return error;
+	return ring_read(&src->ring, rd, uio, ioflag);
 }
 
+// readable when this open has an unread event
 static int
-tsg_synth_close(struct cdev *dev, int fflag, int devtype, struct thread *td)
+tsg_source_poll(struct cdev *dev, int events, struct thread *td)
 {
-	return 0;
+	struct tsg_source *src = dev->si_drv2;
+	struct ring_reader *rd;
+
+	if (devfs_get_cdevpriv((void **)&rd) != 0)
+		return events & (POLLIN | POLLRDNORM) ? POLLERR : 0;
+	return ring_poll(&src->ring, rd, events, td);
+}
+
+static int
+tsg_source_kqfilter(struct cdev *dev, struct knote *kn)
+{
+	struct tsg_source *src = dev->si_drv2;
+	struct ring_reader *rd;
+	int error;
+
+	if ((error = devfs_get_cdevpriv((void **)&rd)) != 0)
+		return error;
+	return ring_kqfilter(&src->ring, rd, kn);
 }
 
 #if 0
@@ -758,10 +1549,8 @@ tsg_get_board_test_status(struct tsg_softc *sc, caddr_t arg)
 	/* 0x11c Background Test Status register (lower nibble) */
 	char *fmt = "n";
 
-	lock(sc);
-        bus_read_region_1(sc->registers_resource, 0x11c, sc->buf, packlen(fmt));
+        reg_read(sc, 0x11c, sc->buf, packlen(fmt));
         unpack(sc->buf, fmt, NULL, argp);	
-	unlock(sc);
 
 	return 0;
 }
@@ -777,10 +1566,8 @@ tsg_get_board_j1(struct tsg_softc *sc, caddr_t arg)
 		*argp = TSG_J1_IRIG_B_AM;
 		return 0;
 	}
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, 0x12f, sc->buf, 1);
+	reg_read(sc, 0x12f, sc->buf, 1);
 	*argp = sc->buf[0];
-	unlock(sc);
 	return 0;
 }
 
@@ -805,9 +1592,7 @@ tsg_set_board_j1(struct tsg_softc *sc, caddr_t arg)
 		return EINVAL;
 	}
 
-	lock(sc);
-	bus_write_region_1(sc->registers_resource, 0x12f, argp, 1);
-	unlock(sc);
+	reg_write(sc, 0x12f, argp, 1);
 	return 0;
 }
 
@@ -822,10 +1607,7 @@ tsg_get_board_pin6(struct tsg_softc *sc, caddr_t arg)
 		return 0;
 	}
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_SYNTH_CONTROL, argp, 1);
-	unlock(sc);
-	*argp &= TSG_BOARD_PIN6_SYNTH;
+	*argp = shadow_get(sc, &sc->synth_control, TSG_BOARD_PIN6_SYNTH);
 	return 0;
 }
 
@@ -833,7 +1615,6 @@ static int
 tsg_set_board_pin6(struct tsg_softc *sc, caddr_t arg)
 {
 	uint8_t *argp = (uint8_t *)arg;
-	uint8_t buf;
 
 	// Cannot change pin6 on old boards; it is always comparator output.
 	if (!sc->new_model)
@@ -841,12 +1622,7 @@ tsg_set_board_pin6(struct tsg_softc *sc, caddr_t arg)
 	if (*argp != 0 && *argp != TSG_BOARD_PIN6_SYNTH)
 		return EINVAL;
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_SYNTH_CONTROL, &buf, 1);
-	buf &= ~(TSG_SYNTH_LOAD | TSG_BOARD_PIN6_SYNTH);
-	buf |= *argp;
-	bus_write_region_1(sc->registers_resource, REG_SYNTH_CONTROL, &buf, 1);
-	unlock(sc);
+	shadow_set(sc, &sc->synth_control, TSG_BOARD_PIN6_SYNTH, *argp);
 	return 0;
 }
 
@@ -857,13 +1633,22 @@ tsg_get_pulse_freq(struct tsg_softc *sc, caddr_t arg)
 	char *fmt = "n";
 
 	/* the upper nibble of 0x11b is the pulse frequency register */
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, 0x11b, sc->buf, packlen(fmt));
+	reg_read(sc, 0x11b, sc->buf, packlen(fmt));
 	unpack(sc->buf, fmt, argp, NULL);
-	unlock(sc);
 	return 0;
 }
 
+static bool
+bench_running(struct tsg_softc *sc)
+{
+	bool running;
+
+	mtx_lock(&sc->notify_mtx);
+	running = sc->bench_state == TSG_BENCH_RUNNING;
+	mtx_unlock(&sc->notify_mtx);
+	return running;
+}
+
 static int
 tsg_set_pulse_freq(struct tsg_softc *sc, caddr_t arg)
 {
@@ -891,10 +1676,11 @@ tsg_set_pulse_freq(struct tsg_softc *sc, caddr_t arg)
 		return EINVAL;
 	}
 
-	lock(sc);
+	if (bench_running(sc))
+		return EBUSY;
 	pack(sc->buf, fmt, *argp, 0);
-	bus_write_region_1(sc->registers_resource, 0x11b, sc->buf, packlen(fmt));
-	unlock(sc);
+	reg_write(sc, 0x11b, sc->buf, packlen(fmt));
+	update_edge_grid(sc);
 	return 0;
 }
 
@@ -902,16 +1688,19 @@ static int
 tsg_get_gps_antenna_status(struct tsg_softc *sc, caddr_t arg)
 {
 	uint8_t *argp = (uint8_t *)arg;
+	struct tsg_telemetry t;
 	char *fmt = "n";
 
 	if (!sc->has_gps)
 		return EOPNOTSUPP;
+	if (telemetry_cached(sc, &t)) {
+		*argp = t.antenna;
+		return 0;
+	}
 
 	/* antenna status is upper nibble of Hardware Status register */
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_HARDWARE_STATUS, sc->buf, packlen(fmt));
+	reg_read(sc, REG_HARDWARE_STATUS, sc->buf, packlen(fmt));
 	unpack(sc->buf, fmt, argp, NULL);
-	unlock(sc);
 
 	/* the antenna status bits are the opposite of what we expect
 	 * (eg 0 means shorted)
@@ -925,15 +1714,15 @@ static int
 tsg_get_clock_lock(struct tsg_softc *sc, caddr_t arg)
 {
 	uint8_t *argp = (uint8_t *)arg;
-	char *fmt = "n";
+	struct tsg_telemetry t;
 
-	/* lock status is upper nibble of lock status register */
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_LOCK_STATUS, sc->buf, packlen(fmt));
-	unpack(sc->buf, fmt, argp, NULL);
-	unlock(sc);
+	if (telemetry_cached(sc, &t)) {
+		*argp = t.lock;
+		return 0;
+	}
+	reg_read(sc, REG_LOCK_STATUS, sc->buf, 1);
 
-	*argp &= (TSG_CLOCK_PHASE_LOCK|TSG_CLOCK_INPUT_VALID|TSG_CLOCK_GPS_LOCK);
+	*argp = decode_clock_lock(sc->buf[0]);
 	return 0;
 }
 
@@ -944,10 +1733,8 @@ tsg_get_clock_timecode(struct tsg_softc *sc, caddr_t arg)
 	char *fmt = "c";
 
 	/* timecode is in register 0x119 */
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, 0x119, sc->buf, packlen(fmt));
+	reg_read(sc, 0x119, sc->buf, packlen(fmt));
 	unpack(sc->buf, fmt, argp);
-	unlock(sc);
 
 	*argp &= TSG_CLOCK_TIMECODE_MASK;
 	return 0;
@@ -968,9 +1755,317 @@ tsg_set_clock_timecode(struct tsg_softc *sc, caddr_t arg)
 		return ENODEV;
 	}
 
-	lock(sc);
-	bus_write_region_1(sc->registers_resource, 0x119, argp, 1);
-	unlock(sc);
+	reg_write(sc, 0x119, argp, 1);
+	return 0;
+}
+
+// Clock presets. The board takes between 19mS and 190mS to load a preset
+// time and clear TIME_READY, so rather than have the caller wait,
+// preset_callout polls for it every 10mS, giving up after a second.
+// REG_CONFIG must not be written while a preset is in progress, since that
+// would clear TIME_READY.
+
+static bool
+preset_busy(struct tsg_softc *sc)
+{
+	bool busy;
+
+	mtx_lock(&sc->notify_mtx);
+	busy = sc->preset_state == TSG_PRESET_BUSY;
+	mtx_unlock(&sc->notify_mtx);
+	return busy;
+}
+
+static int
+preset_poll_ticks(void)
+{
+	return MAX(hz / 100, 1);
+}
+
+static void
+tsg_preset_poll(void *arg)
+{
+	struct tsg_softc *sc = arg;
+	uint8_t reg;
+
+	mtx_assert(&sc->notify_mtx, MA_OWNED);
+	reg_in(sc, &sc->bus_preset, REG_CONFIG, &reg, 1);
+	sc->bus_preset.calls++;
+	if ((reg & TSG_PRESET_TIME_READY) == 0)
+		sc->preset_state = TSG_PRESET_DONE;
+	else if (ticks - sc->preset_start >= hz)
+		sc->preset_state = TSG_PRESET_TIMEOUT;
+	else {
+		callout_schedule(&sc->preset_callout, preset_poll_ticks());
+		return;
+	}
+
+	sc->preset_ticks = ticks - sc->preset_start;
+	sc->preset_done = sc->preset_gen;
+	selwakeup(&sc->main_sel);
+	KNOTE_LOCKED(&sc->main_sel.si_note, 0);
+}
+
+static void
+preset_start(struct tsg_softc *sc)
+{
+	mtx_lock(&sc->notify_mtx);
+	sc->preset_state = TSG_PRESET_BUSY;
+	sc->preset_gen++;
+	sc->preset_start = ticks;
+	callout_reset(&sc->preset_callout, preset_poll_ticks(), tsg_preset_poll, sc);
+	mtx_unlock(&sc->notify_mtx);
+}
+
+// Report the latest preset, and mark it collected for poll(2).
+static int
+tsg_get_clock_preset(struct tsg_softc *sc, caddr_t arg)
+{
+	struct tsg_preset_status *argp = (struct tsg_preset_status *)arg;
+	struct tsg_open *op;
+	int t, error;
+
+	if ((error = devfs_get_cdevpriv((void **)&op)) != 0)
+		return error;
+
+	mtx_lock(&sc->notify_mtx);
+	argp->generation = sc->preset_gen;
+	argp->state = sc->preset_state;
+	t = sc->preset_state == TSG_PRESET_BUSY ? ticks - sc->preset_start : sc->preset_ticks;
+	argp->msec = (uint64_t)t * 1000 / hz;
+	op->preset_seen = sc->preset_done;
+	mtx_unlock(&sc->notify_mtx);
+
+	return 0;
+}
+
+// Read the satellite table. The receiver flags 0x1b0 while it rewrites the
+// table, so a read that overlaps an update is tried again; returns false
+// if the table never held still.
+static bool
+read_gps_signal(struct tsg_softc *sc, struct tsg_busacct *acct, struct tsg_signal *sig)
+{
+	uint8_t buf[bcd_satellite_len * TSG_MAX_SATELLITES];
+	uint8_t updating;
+	struct bcd_satellite b;
+	struct tsg_satellite *sat;
+	int i, tries;
+
+	for (tries = 0; tries < 10; ++tries) {
+		reg_in(sc, acct, 0x1b0, &updating, 1);
+		if (updating)
+			continue;
+		reg_in(sc, acct, 0x198, buf, sizeof(buf));
+		reg_in(sc, acct, 0x1b0, &updating, 1);
+		if (!updating)
+			break;
+	}
+	if (tries == 10)
+		return false;
+
+	for (i = 0; i < TSG_MAX_SATELLITES; ++i) {
+		bcd_satellite_decode(buf + i * bcd_satellite_len, &b);
+		sat = sig->satellites + i;
+		sat->sv = b.tens_sv * 10 + b.unit_sv;
+		sat->level = b.tens_signal * 10 + b.units_signal;
+		sat->centilevel = b.tenth_signal * 10 + b.hundredth_signal;
+	}
+	return true;
+}
+
+// Status watch and telemetry. Rather than have monitors poll the status
+// registers with ioctls, watch_callout samples them, queues a record when
+// they change, and caches the sample for the getters. The first sample is
+// only a baseline for changes.
+
+static int
+watch_ticks(uint32_t ms)
+{
+	return MAX((uint64_t)ms * hz / 1000, 1);
+}
+
+static void
+watch_sample(struct tsg_softc *sc, struct tsg_telemetry *t)
+{
+	struct timespec now;
+	uint8_t buf[4];
+	uint8_t reg;
+
+	memset(t, 0, sizeof(*t));
+	nanotime(&now);
+	set_timespec(&t->timestamp, &now);
+
+	reg_in(sc, &sc->bus_watch, REG_LOCK_STATUS, &reg, 1);
+	t->lock = decode_clock_lock(reg);
+
+	// antenna status is the inverted upper nibble of the hardware status
+	if (sc->has_gps) {
+		reg_in(sc, &sc->bus_watch, REG_HARDWARE_STATUS, &reg, 1);
+		t->antenna = ~(reg >> 4) & (TSG_GPS_ANTENNA_SHORTED|TSG_GPS_ANTENNA_OPEN);
+	}
+
+	// test status, timecode quality and the DAC share a word
+	reg_in(sc, &sc->bus_watch, 0x11c, buf, sizeof(buf));
+	t->test_status = buf[0] & 0x0f;
+	if (sc->new_model)
+		decode_timecode_quality(buf[REG_TIMECODE_QUALITY - 0x11c], &t->quality);
+	t->dac = le16dec(&buf[2]);
+
+	// keep the last table if the receiver was busy updating it
+	if (sc->has_gps) {
+		if (read_gps_signal(sc, &sc->bus_watch, &t->signal))
+			t->flags |= TSG_TELEMETRY_SIGNAL;
+		else if (sc->watch_valid) {
+			t->signal = sc->telemetry.signal;
+			t->flags |= sc->telemetry.flags & TSG_TELEMETRY_SIGNAL;
+		}
+	}
+}
+
+static void
+watch_changes(struct tsg_softc *sc, struct tsg_telemetry *old, struct tsg_telemetry *new)
+{
+	struct tsg_status_change c;
+
+	memset(&c, 0, sizeof(c));
+	if (new->lock != old->lock)
+		c.changed |= TSG_CHANGE_LOCK;
+	if (new->antenna != old->antenna)
+		c.changed |= TSG_CHANGE_ANTENNA;
+	if (new->quality.locked != old->quality.locked || new->quality.level != old->quality.level)
+		c.changed |= TSG_CHANGE_QUALITY;
+	if (new->test_status != old->test_status)
+		c.changed |= TSG_CHANGE_TEST;
+	if (c.changed == 0)
+		return;
+
+	c.sequence = ++sc->watch_seq;
+	c.timestamp = new->timestamp;
+	c.lock = new->lock;
+	c.antenna = new->antenna;
+	c.quality = new->quality;
+	c.test_status = new->test_status;
+	ring_put(&sc->status_ring, &c);
+	selwakeup(&sc->main_sel);
+	KNOTE_LOCKED(&sc->main_sel.si_note, 0);
+}
+
+static void
+tsg_watch_poll(void *arg)
+{
+	struct tsg_softc *sc = arg;
+	struct tsg_telemetry t;
+
+	mtx_assert(&sc->notify_mtx, MA_OWNED);
+	sc->bus_watch.calls++;
+	watch_sample(sc, &t);
+	if (sc->watch_valid)
+		watch_changes(sc, &sc->telemetry, &t);
+	if (!sc->watch_valid || ticks - sc->telemetry_kept >= hz) {
+		ring_put(&sc->telemetry_ring, &t);
+		sc->telemetry_kept = ticks;
+	}
+	sc->telemetry = t;
+	sc->telemetry_ticks = ticks;
+	sc->watch_valid = true;
+	callout_schedule(&sc->watch_callout, watch_ticks(sc->watch_ms));
+}
+
+// Copy the latest sample to t if it is recent enough to stand in for
+// reading the board: sampling is on, and it is no more than two periods old.
+static bool
+telemetry_cached(struct tsg_softc *sc, struct tsg_telemetry *t)
+{
+	bool fresh;
+
+	mtx_lock(&sc->notify_mtx);
+	fresh = sc->watch_ms != 0 && sc->watch_valid &&
+	    ticks - sc->telemetry_ticks <= 2 * watch_ticks(sc->watch_ms);
+	if (fresh)
+		*t = sc->telemetry;
+	mtx_unlock(&sc->notify_mtx);
+	return fresh;
+}
+
+static int
+tsg_get_telemetry(struct tsg_softc *sc, caddr_t arg)
+{
+	struct tsg_telemetry_current *argp = (struct tsg_telemetry_current *)arg;
+	int error = 0;
+
+	mtx_lock(&sc->notify_mtx);
+	if (!sc->watch_valid)
+		error = EAGAIN;
+	else {
+		argp->sample = sc->telemetry;
+		argp->age_ms = (uint64_t)(ticks - sc->telemetry_ticks) * 1000 / hz;
+	}
+	mtx_unlock(&sc->notify_mtx);
+	return error;
+}
+
+// Copy out the latest count samples from the history, oldest first. They are
+// gathered under the lock, and copied out once it is dropped.
+static int
+tsg_get_telemetry_history(struct tsg_softc *sc, caddr_t arg)
+{
+	struct tsg_telemetry_history *argp = (struct tsg_telemetry_history *)arg;
+	struct ring *r = &sc->telemetry_ring;
+	struct tsg_telemetry *buf;
+	struct ring_reader rd;
+	uint32_t n = MIN(argp->count, TSG_TELEMETRY_HISTORY);
+	int error;
+
+	if (n == 0)
+		return 0;
+	buf = malloc(n * sizeof(*buf), M_DEVBUF, M_WAITOK);
+	mtx_lock(&sc->notify_mtx);
+	rd.ring = r;
+	rd.next = r->head - MIN(n, r->head);
+	rd.lost = 0;
+	n = ring_get(r, &rd, buf, n);
+	mtx_unlock(&sc->notify_mtx);
+
+	error = copyout(buf, (void *)(uintptr_t)argp->samples, n * sizeof(*buf));
+	argp->count = n;
+	free(buf, M_DEVBUF);
+	return error;
+}
+
+// start watching at watch_ms, or stop if it is 0; changes made while
+// stopped are reported by the first sample after starting again
+static void
+watch_start(struct tsg_softc *sc)
+{
+	mtx_assert(&sc->notify_mtx, MA_OWNED);
+	if (sc->watch_ms == 0)
+		callout_stop(&sc->watch_callout);
+	else
+		callout_reset(&sc->watch_callout, watch_ticks(sc->watch_ms), tsg_watch_poll, sc);
+}
+
+static int
+tsg_get_watch_interval(struct tsg_softc *sc, caddr_t arg)
+{
+	uint32_t *argp = (uint32_t *)arg;
+
+	mtx_lock(&sc->notify_mtx);
+	*argp = sc->watch_ms;
+	mtx_unlock(&sc->notify_mtx);
+	return 0;
+}
+
+static int
+tsg_set_watch_interval(struct tsg_softc *sc, caddr_t arg)
+{
+	uint32_t *argp = (uint32_t *)arg;
+
+	if (*argp > TSG_WATCH_MAX_MS)
+		return EINVAL;
+	mtx_lock(&sc->notify_mtx);
+	sc->watch_ms = *argp;
+	watch_start(sc);
+	mtx_unlock(&sc->notify_mtx);
 	return 0;
 }
 
@@ -979,11 +2074,7 @@ tsg_get_clock_ref(struct tsg_softc *sc, caddr_t arg)
 {
 	uint8_t *argp = (uint8_t *)arg;
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_CONFIG, argp, 1);
-	unlock(sc);
-
-	*argp &= TSG_CLOCK_REF_MASK;
+	*argp = shadow_get(sc, &sc->config, TSG_CLOCK_REF_MASK);
 	return 0;
 }
 
@@ -1003,31 +2094,76 @@ tsg_set_clock_ref(struct tsg_softc *sc, caddr_t arg)
 		break;
 	}
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_CONFIG, sc->buf, 1);
-	sc->buf[0] &= ~TSG_CLOCK_REF_MASK;	// clear ref bits
-	sc->buf[0] |= *argp;			// set new ref bits
-	bus_write_region_1(sc->registers_resource, REG_CONFIG, sc->buf, 1);
-	unlock(sc);
+	if (preset_busy(sc))
+		return EBUSY;
+	shadow_set(sc, &sc->config, TSG_CLOCK_REF_MASK, *argp);
 	return 0;
 }
 
+// latch and read the board time, noting the cycle counter at the latch
+static void
+read_clock_time(struct tsg_softc *sc, struct tsg_time *t, uint64_t *cycles)
+{
+
+	latch_lock(sc);
+	*cycles = get_cyclecount();
+	reg_write(sc, 0xfc, sc->buf, 1);
+	read_bcd_time(sc, sc->bus_acct, sc->buf);
+	latch_unlock(sc);
+
+	bcdtime_decode(sc->buf, sc->new_model, t);
+}
+
 static int
 tsg_get_clock_time(struct tsg_softc *sc, caddr_t arg)
 {
 	struct tsg_time *argp = (struct tsg_time *)arg;
+	uint64_t cycles;
 
-	lock(sc);
-	bus_write_region_1(sc->registers_resource, 0xfc, sc->buf, 1);
+	read_clock_time(sc, argp, &cycles);
+	return 0;
+}
+
+static int
+tsg_get_clock_time_cycles(struct tsg_softc *sc, caddr_t arg)
+{
+	struct tsg_time_cycles *argp = (struct tsg_time_cycles *)arg;
 
-	read_bcd_time(sc);
-	struct bcd_time b;
-	unpack_bcd_time(sc->buf, &b);
+	read_clock_time(sc, &argp->time, &argp->cycles);
+	return 0;
+}
 
-	unlock(sc);
+// Bracket each board time latch with system clock reads. The latch write
+// may be posted, so post is read after the first word of the latched time,
+// which can't come back until the write has reached the board.
+static int
+tsg_get_clock_offset(struct tsg_softc *sc, caddr_t arg)
+{
+	struct tsg_clock_offset *argp = (struct tsg_clock_offset *)arg;
+	struct tsg_offset_sample *s;
+	struct timespec pre, post;
+	uint8_t buf[sizeof(sc->buf)];
+	uint8_t latch = 0;
+	uint32_t i;
 
-	bcd2time(&b, argp, sc->new_model);
+	if (argp->samples == 0 || argp->samples > TSG_OFFSET_MAX_SAMPLES)
+		return EINVAL;
 
+	for (i = 0; i < argp->samples; ++i) {
+		s = &argp->sample[i];
+		latch_lock(sc);
+		nanotime(&pre);
+		s->cycles = get_cyclecount();
+		reg_write(sc, 0xfc, &latch, 1);
+		reg_read(sc, 0xfc, buf, 4);
+		nanotime(&post);
+		reg_read(sc, 0x100, buf + 4, bcd_time_len - 4);
+		latch_unlock(sc);
+
+		set_timespec(&s->pre, &pre);
+		set_timespec(&s->post, &post);
+		bcdtime_decode(buf, sc->new_model, &s->board);
+	}
 	return 0;
 }
 
@@ -1060,25 +2196,16 @@ tsg_set_clock_time(struct tsg_softc *sc, caddr_t arg)
 	struct tsg_time t = *(struct tsg_time *)arg;
 	uint8_t ref;
 	uint16_t milli;
-	uint8_t thousands_year, hundreds_year, tens_year, units_year;
-	uint8_t hundreds_day, tens_day, units_day;
-	uint8_t tens_hour, units_hour;
-	uint8_t tens_min, units_min;
-	uint8_t tens_sec, units_sec;
-	uint8_t hundreds_milli, tens_milli, units_milli;
-	char *fmt;
-	uint8_t control;
 
-	lock(sc);
+	// the preset registers are in use
+	if (preset_busy(sc))
+		return EBUSY;
 
 	// get current clock reference so we know which parts of the time to set
-	bus_read_region_1(sc->registers_resource, REG_CONFIG, &ref, 1);
-	ref &= TSG_CLOCK_REF_MASK;
+	ref = shadow_get(sc, &sc->config, TSG_CLOCK_REF_MASK);
 
-	if (!is_valid_time(ref, &t)) {
-		unlock(sc);
+	if (!is_valid_time(ref, &t))
 		return EINVAL;
-	}
 
 	switch (ref) {
 	case TSG_CLOCK_REF_GEN:
@@ -1088,69 +2215,45 @@ tsg_set_clock_time(struct tsg_softc *sc, caddr_t arg)
 			// so calculate how many milliseconds to go,
 			milli = 1000 - milli;
 		}
-		ushort2bcd(milli, NULL, NULL, &hundreds_milli, &tens_milli, &units_milli);
-		fmt = "nn";
-		pack(sc->buf, fmt, units_milli, 0, hundreds_milli, tens_milli);
-		bus_write_region_1(sc->registers_resource, 0x159, sc->buf, packlen(fmt));
+		// units of msec in the high nibble, then hundreds and tens
+		sc->buf[0] = (milli % 10) << 4;
+		sc->buf[1] = bin2bcd(milli / 10);
+		reg_write(sc, 0x159, sc->buf, 2);
 		// fallthrough
 
 	case TSG_CLOCK_REF_1PPS:
-		ushort2bcd(t.sec, NULL, NULL, NULL, &tens_sec, &units_sec);
-		fmt = "n";
-		pack(sc->buf, fmt, tens_sec, units_sec);
-		bus_write_region_1(sc->registers_resource, 0x15b, sc->buf, packlen(fmt));
-
-		ushort2bcd(t.min, NULL, NULL, NULL, &tens_min, &units_min);
-		pack(sc->buf, fmt, tens_min, units_min);
-		bus_write_region_1(sc->registers_resource, 0x15c, sc->buf, packlen(fmt));
-
-		ushort2bcd(t.hour, NULL, NULL, NULL, &tens_hour, &units_hour);
-		pack(sc->buf, fmt, tens_hour, units_hour);
-		bus_write_region_1(sc->registers_resource, 0x15d, sc->buf, packlen(fmt));
-
-		ushort2bcd(t.day, NULL, NULL, &hundreds_day, &tens_day, &units_day);
-		fmt = "nn";
-		pack(sc->buf, fmt, tens_day, units_day, 0, hundreds_day);
-		bus_write_region_1(sc->registers_resource, 0x15e, sc->buf, packlen(fmt));
+		sc->buf[0] = bin2bcd(t.sec);
+		reg_write(sc, 0x15b, sc->buf, 1);
+
+		sc->buf[0] = bin2bcd(t.min);
+		reg_write(sc, 0x15c, sc->buf, 1);
+
+		sc->buf[0] = bin2bcd(t.hour);
+		reg_write(sc, 0x15d, sc->buf, 1);
+
+		sc->buf[0] = bin2bcd(t.day % 100);
+		sc->buf[1] = t.day / 100;
+		reg_write(sc, 0x15e, sc->buf, 2);
 		// fallthrough
 
 	case TSG_CLOCK_REF_GPS:
 	case TSG_CLOCK_REF_TIMECODE:
-		ushort2bcd(t.year, NULL, &thousands_year, &hundreds_year, &tens_year, &units_year);
-		fmt = "nn";
-		pack(sc->buf, fmt, tens_year, units_year, thousands_year, hundreds_year);
-		bus_write_region_1(sc->registers_resource, 0x160, sc->buf, packlen(fmt));
+		sc->buf[0] = bin2bcd(t.year % 100);
+		sc->buf[1] = bin2bcd(t.year / 100);
+		reg_write(sc, 0x160, sc->buf, 2);
 		break;
 
 	default:
-		unlock(sc);
 		return EIO;	// problem; we don't expect any other values
 		break;
 	}
 
-	bus_read_region_1(sc->registers_resource, REG_CONFIG, &control, 1);
-	control &= ~TSG_PRESET_POS_READY;	// always clear; we're not setting pos here
-	control |= TSG_PRESET_TIME_READY;
-	bus_write_region_1(sc->registers_resource, REG_CONFIG, &control, 1);
-
-	// Wait for up to a second for TIME_READY to clear/
-	// I've seen it take between 19mS and 190mS, so poll every 10mS.
-	struct timeval tv = {
-		.tv_sec = 0,
-		.tv_usec = 10 * 1000,	// 10mS
-	};
-	int timo = tvtohz(&tv);
-
-	// wait for TIME_READY to clear
-	int tries;
-	for (tries = 0; tries < 100; ++tries) {
-		bus_read_region_1(sc->registers_resource, REG_CONFIG, &control, 1);
-		if ((control & TSG_PRESET_TIME_READY) == 0)
-			break;
-		pause("timrdy", timo);
-	}
-	unlock(sc);
-	return tries >= 100 ? ETIMEDOUT : 0;
+	// POS_READY is always clear; we're not setting pos here
+	shadow_set(sc, &sc->config, TSG_PRESET_TIME_READY, TSG_PRESET_TIME_READY);
+
+	// don't wait for the board; TSG_GET_CLOCK_PRESET reports how it went
+	preset_start(sc);
+	return 0;
 }
 
 
@@ -1158,93 +2261,62 @@ static int
 tsg_get_gps_position(struct tsg_softc *sc, caddr_t arg)
 {
 	struct tsg_position *argp = (struct tsg_position *)arg;
-	char *fmt = "nnncnn nnncnn ncnn";
-	uint8_t lat_hundreds_deg, lat_tens_deg, lat_units_deg;
-	uint8_t lat_tens_min, lat_units_min;
-	uint8_t lat_tens_sec, lat_units_sec, lat_decisec;
-	uint8_t lat_dir;
-	uint8_t lon_hundreds_deg, lon_tens_deg, lon_units_deg;
-	uint8_t lon_tens_min, lon_units_min;
-	uint8_t lon_tens_sec, lon_units_sec, lon_decisec;
-	uint8_t lon_dir;
-	uint8_t elev_tens_km, elev_unit_km;
-	uint8_t elev_hundreds_meter, elev_tens_meter, elev_units_meter, elev_decimeter;
-	uint8_t elev_sign;
-
-	uint8_t prev_buf[packlen(fmt)];
-	memset(prev_buf, 0, packlen(fmt));
+	struct bcd_position b;
+
+	uint8_t prev_buf[bcd_position_len];
+	memset(prev_buf, 0, bcd_position_len);
 
-	lock(sc);
 	/* The old model requires writing something to 0xfc to freeze the position
 	 * registers.
 	 * For the new model, the position registers can be read any time, but should
 	 * be read twice and compared to make sure the values aren't changing.
 	 */
 	if (!sc->new_model) {
-		bus_write_region_1(sc->registers_resource, 0xfc, sc->buf, 1);
-		bus_read_region_1(sc->registers_resource, 0x108, sc->buf, packlen(fmt));
+		latch_lock(sc);
+		reg_write(sc, 0xfc, sc->buf, 1);
+		reg_read(sc, REG_POSITION, sc->buf, bcd_position_len);
+		latch_unlock(sc);
 	} else {
 		int tries = 0;
 		while (tries++ < 10) {
-			bus_read_region_1(sc->registers_resource, 0x108, sc->buf, packlen(fmt));
-			if (memcmp(sc->buf, prev_buf, packlen(fmt)) == 0)
+			reg_read(sc, REG_POSITION, sc->buf, bcd_position_len);
+			if (memcmp(sc->buf, prev_buf, bcd_position_len) == 0)
 				break;
-			memcpy(prev_buf, sc->buf, packlen(fmt));
+			memcpy(prev_buf, sc->buf, bcd_position_len);
 		}
-		if (tries == 10) {
-			unlock(sc);
+		if (tries == 10)
 			return EIO;
-		}
 	}
 
-	unpack(sc->buf, fmt,
-		&lat_tens_deg,        &lat_units_deg,
-		NULL,                 &lat_hundreds_deg,
-		&lat_tens_min,        &lat_units_min,
-		&lat_dir,
-		NULL,                 &lat_decisec,
-		&lat_tens_sec,        &lat_units_sec,
-		&lon_tens_deg,        &lon_units_deg,
-		NULL,                 &lon_hundreds_deg,
-		&lon_tens_min,        &lon_units_min,
-		&lon_dir,
-		NULL,                 &lon_decisec,
-		&lon_tens_sec,        &lon_units_sec,
-		&elev_tens_km,        &elev_unit_km,
-		&elev_sign,
-		&elev_units_meter,    &elev_decimeter,
-		&elev_hundreds_meter, &elev_tens_meter
-	);
-
-	unlock(sc);
-
-	argp->lat_deg = lat_hundreds_deg * 100 +
-		        lat_tens_deg * 10 +
-			lat_units_deg;
-	argp->lat_min = lat_tens_min * 10 +
-		        lat_units_min;
-	argp->lat_sec = lat_tens_sec * 10 +
-	                lat_units_sec;
-	argp->lat_decisec = lat_decisec;
-	argp->lat_dir = lat_dir;
-
-	argp->lon_deg = lon_hundreds_deg * 100 +
-		        lon_tens_deg * 10 +
-			lon_units_deg;
-	argp->lon_min = lon_tens_min * 10 +
-		        lon_units_min;
-	argp->lon_sec = lon_tens_sec * 10 +
-	                lon_units_sec;
-	argp->lon_decisec = lon_decisec;
-	argp->lon_dir = lon_dir;
-
-	argp->elev_meter = elev_tens_km * 10000 +
-		           elev_unit_km * 1000 +
-			   elev_hundreds_meter * 100 +
-			   elev_tens_meter * 10 +
-			   elev_units_meter;
-	argp->elev_decimeter = elev_decimeter;
-	argp->elev_sign = elev_sign;
+	bcd_position_decode(sc->buf, &b);
+
+	argp->lat_deg = b.lat_hundreds_deg * 100 +
+		        b.lat_tens_deg * 10 +
+			b.lat_units_deg;
+	argp->lat_min = b.lat_tens_min * 10 +
+		        b.lat_units_min;
+	argp->lat_sec = b.lat_tens_sec * 10 +
+	                b.lat_units_sec;
+	argp->lat_decisec = b.lat_decisec;
+	argp->lat_dir = b.lat_dir;
+
+	argp->lon_deg = b.lon_hundreds_deg * 100 +
+		        b.lon_tens_deg * 10 +
+			b.lon_units_deg;
+	argp->lon_min = b.lon_tens_min * 10 +
+		        b.lon_units_min;
+	argp->lon_sec = b.lon_tens_sec * 10 +
+	                b.lon_units_sec;
+	argp->lon_decisec = b.lon_decisec;
+	argp->lon_dir = b.lon_dir;
+
+	argp->elev_meter = b.elev_tens_km * 10000 +
+		           b.elev_unit_km * 1000 +
+			   b.elev_hundreds_meter * 100 +
+			   b.elev_tens_meter * 10 +
+			   b.elev_units_meter;
+	argp->elev_decimeter = b.elev_decimeter;
+	argp->elev_sign = b.elev_sign;
 
 	return 0;
 }
@@ -1253,54 +2325,13 @@ static int
 tsg_get_gps_signal(struct tsg_softc *sc, caddr_t arg)
 {
 	struct tsg_signal *argp = (struct tsg_signal *)arg;
-	uint8_t updating;
-	char *fmt = "ncnn";
-
-	lock(sc);
-	int tries = 0;
-	while (tries++ < 10) {
-		bus_read_region_1(sc->registers_resource, 0x1b0, &updating, 1);
-		if (updating)
-			continue;
-		bus_read_region_1(
-			sc->registers_resource,
-			0x198,
-			sc->buf,
-			packlen(fmt) * TSG_MAX_SATELLITES
-		);
-		bus_read_region_1(sc->registers_resource, 0x1b0, &updating, 1);
-		if (updating)
-			continue;
-		break;
-	}
-	if (tries == 10) {
-		unlock(sc);
-		return EIO;
-	}
+	struct tsg_telemetry t;
 
-	int i;
-	uint8_t *buf = sc->buf;
-	struct tsg_satellite *sat;
-	uint8_t tens_sv, unit_sv;
-	uint8_t tens_signal, units_signal;
-	uint8_t tenth_signal, hundredth_signal;
-
-	for (i = 0; i < TSG_MAX_SATELLITES; ++i) {
-		buf = unpack(buf, fmt, 
-			&tens_sv, &unit_sv,
-			NULL,
-			&tenth_signal, &hundredth_signal,
-			&tens_signal, &units_signal
-		);
-
-		sat = argp->satellites + i;
-		sat->sv = tens_sv * 10 + unit_sv;
-		sat->level = tens_signal * 10 + units_signal;
-		sat->centilevel = tenth_signal * 10 + hundredth_signal;
+	if (telemetry_cached(sc, &t) && (t.flags & TSG_TELEMETRY_SIGNAL)) {
+		*argp = t.signal;
+		return 0;
 	}
-
-	unlock(sc);
-	return 0;
+	return read_gps_signal(sc, sc->bus_acct, argp) ? 0 : EIO;
 }
 
 static int
@@ -1315,10 +2346,8 @@ tsg_get_timecode_agc_delays(struct tsg_softc *sc, caddr_t arg)
 	if (!sc->new_model)
 		return EOPNOTSUPP;
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, 0x1b4, sc->buf, packlen(fmt));
+	reg_read(sc, 0x1b4, sc->buf, packlen(fmt));
 	unpack(sc->buf, fmt, &irig_b_usec, &irig_b_nsec, &irig_a_usec, &irig_a_nsec);
-	unlock(sc);
 
 	argp->irig_a_nsec = irig_a_usec * 1000 + irig_a_nsec;
 	argp->irig_b_nsec = irig_b_usec * 1000 + irig_b_nsec;
@@ -1331,10 +2360,7 @@ tsg_get_clock_leap(struct tsg_softc *sc, caddr_t arg)
 {
 	uint8_t *argp = (uint8_t *) arg;
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_MISC_CONTROL, argp, 1);
-	unlock(sc);
-	*argp &= TSG_INSERT_LEAP;
+	*argp = shadow_get(sc, &sc->misc_control, TSG_INSERT_LEAP);
 	return 0;
 }
 
@@ -1346,19 +2372,11 @@ tsg_set_clock_leap(struct tsg_softc *sc, caddr_t arg)
 	if (*argp != 0 && *argp != TSG_INSERT_LEAP)
 		return ENODEV;
 
-	lock(sc);
-
-	if (!sc->new_model)
-		sc->buf[0] = 0;
-	else {
-		/* New boards support 'use TQ' in REG_MISC_CONTROL register */
-		bus_read_region_1(sc->registers_resource, REG_MISC_CONTROL, sc->buf, 1);
-		sc->buf[0] &= TSG_USE_TQ;
-	}
-	sc->buf[0] |= *argp;
-
-	bus_write_region_1(sc->registers_resource, REG_MISC_CONTROL, sc->buf, 1);
-	unlock(sc);
+	/* New boards keep 'use TQ' in REG_MISC_CONTROL; old boards have nothing else there */
+	if (sc->new_model)
+		shadow_set(sc, &sc->misc_control, TSG_INSERT_LEAP, *argp);
+	else
+		shadow_set(sc, &sc->misc_control, 0xff, *argp);
 
 	return 0;
 }
@@ -1367,13 +2385,17 @@ static int
 tsg_get_clock_dac(struct tsg_softc *sc, caddr_t arg)
 {
 	uint16_t *argp = (uint16_t *)arg;
+	struct tsg_telemetry t;
 	char *fmt = "s";
 
-	lock(sc);
+	if (telemetry_cached(sc, &t)) {
+		*argp = t.dac;
+		return 0;
+	}
+
 	/* 0x11e is the low byte, and 0x11f is the high byte */
-	bus_read_region_1(sc->registers_resource, 0x11e, sc->buf, packlen(fmt));
+	reg_read(sc, 0x11e, sc->buf, packlen(fmt));
 	unpack(sc->buf, fmt, argp);
-	unlock(sc);
 
 	return 0;
 }
@@ -1381,14 +2403,8 @@ tsg_get_clock_dac(struct tsg_softc *sc, caddr_t arg)
 static int
 tsg_save_clock_dac(struct tsg_softc *sc, caddr_t UNUSED(arg))
 {
-	uint8_t buf;
-
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_MISC_CONTROL, &buf, 1);
-	buf &= (TSG_USE_TQ | TSG_INSERT_LEAP);	// clear all except use TQ and insert leap bits
-	buf |= TSG_SAVE_DAC;
-	bus_write_region_1(sc->registers_resource, REG_MISC_CONTROL, &buf, 1);
-	unlock(sc);
+	// keeps use TQ and insert leap
+	shadow_set(sc, &sc->misc_control, TSG_SAVE_DAC, TSG_SAVE_DAC);
 
 	return 0;
 }
@@ -1398,10 +2414,7 @@ tsg_get_clock_dst(struct tsg_softc *sc, caddr_t arg)
 {
 	uint8_t *argp = (uint8_t *)arg;
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_CONFIG, argp, 1);
-	unlock(sc);
-	*argp &= TSG_CLOCK_DST_ENABLE;
+	*argp = shadow_get(sc, &sc->config, TSG_CLOCK_DST_ENABLE);
 
 	return 0;
 }
@@ -1410,19 +2423,13 @@ static int
 tsg_set_clock_dst(struct tsg_softc *sc, caddr_t arg)
 {
 	uint8_t *argp = (uint8_t *)arg;
-	uint8_t buf;
 
 	if (*argp != 0 && *argp != TSG_CLOCK_DST_ENABLE)
 		return ENODEV;
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_CONFIG, &buf, 1);
-	// clear the preset and dst bits
-	buf &= ~(TSG_PRESET_TIME_READY | TSG_PRESET_POS_READY | TSG_CLOCK_DST_ENABLE);
-	// set the dst bit
-	buf |= *argp;
-	bus_write_region_1(sc->registers_resource, REG_CONFIG, &buf, 1);
-	unlock(sc);
+	if (preset_busy(sc))
+		return EBUSY;
+	shadow_set(sc, &sc->config, TSG_CLOCK_DST_ENABLE, *argp);
 
 	return 0;
 }
@@ -1432,10 +2439,7 @@ tsg_get_clock_stop(struct tsg_softc *sc, caddr_t arg)
 {
 	uint8_t *argp = (uint8_t *)arg;
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_CONFIG, argp, 1);
-	unlock(sc);
-	*argp &= TSG_CLOCK_STOP;
+	*argp = shadow_get(sc, &sc->config, TSG_CLOCK_STOP);
 
 	return 0;
 }
@@ -1444,19 +2448,13 @@ static int
 tsg_set_clock_stop(struct tsg_softc *sc, caddr_t arg)
 {
 	uint8_t *argp = (uint8_t *)arg;
-	uint8_t buf;
 
 	if (*argp != 0 && *argp != TSG_CLOCK_STOP)
 		return ENODEV;
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_CONFIG, &buf, 1);
-	// clear the preset and clock stop bits
-	buf &= ~(TSG_PRESET_TIME_READY | TSG_PRESET_POS_READY | TSG_CLOCK_STOP);
-	// set the generator stop bit
-	buf |= *argp;
-	bus_write_region_1(sc->registers_resource, REG_CONFIG, &buf, 1);
-	unlock(sc);
+	if (preset_busy(sc))
+		return EBUSY;
+	shadow_set(sc, &sc->config, TSG_CLOCK_STOP, *argp);
 
 	return 0;
 }
@@ -1465,24 +2463,14 @@ static int
 tsg_get_clock_tz_offset(struct tsg_softc *sc, caddr_t arg)
 {
 	struct tsg_tz_offset *argp = (struct tsg_tz_offset *)arg;
-	char *fmt = "n n c c";
-	uint8_t tens_min, units_min;
-	uint8_t tens_hour, units_hour;
-	uint8_t sign, dummy;
+	struct bcd_tz_offset b;
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_TZ_OFFSET, sc->buf, packlen(fmt));
-	unpack(sc->buf, fmt,
-		&tens_min,	&units_min,
-		&tens_hour,	&units_hour,
-		&sign,
-		&dummy
-	);
-	unlock(sc);
+	reg_read(sc, REG_TZ_OFFSET, sc->buf, bcd_tz_offset_len);
+	bcd_tz_offset_decode(sc->buf, &b);
 
-	argp->sign = sign;
-	argp->hour = tens_hour * 10 + units_hour;
-	argp->min = tens_min * 10 + units_min;
+	argp->sign = b.sign;
+	argp->hour = b.tens_hour * 10 + b.units_hour;
+	argp->min = b.tens_min * 10 + b.units_min;
 
 	return 0;
 }
@@ -1491,9 +2479,7 @@ static int
 tsg_set_clock_tz_offset(struct tsg_softc *sc, caddr_t arg)
 {
 	struct tsg_tz_offset *argp = (struct tsg_tz_offset *)arg;
-	char *fmt = "n n c c";
-	uint8_t tens_min, units_min;
-	uint8_t tens_hour, units_hour;
+	struct bcd_tz_offset b;
 
 	if (argp->sign != '-' && argp->sign != '+')
 		return ENODEV;
@@ -1502,18 +2488,13 @@ tsg_set_clock_tz_offset(struct tsg_softc *sc, caddr_t arg)
 	if (argp->min > 59)
 		return ENODEV;
 
-	ushort2bcd(argp->hour, NULL, NULL, NULL, &tens_hour, &units_hour);
-	ushort2bcd(argp->min, NULL, NULL, NULL, &tens_min, &units_min);
+	memset(&b, 0, sizeof(b));
+	ushort2bcd(argp->hour, NULL, NULL, NULL, &b.tens_hour, &b.units_hour);
+	ushort2bcd(argp->min, NULL, NULL, NULL, &b.tens_min, &b.units_min);
+	b.sign = argp->sign;
 
-	lock(sc);
-	pack(sc->buf, fmt,
-		tens_min,	units_min,
-		tens_hour,	units_hour,
-		argp->sign,
-		0
-	);
-	bus_write_region_1(sc->registers_resource, REG_TZ_OFFSET, sc->buf, packlen(fmt));
-	unlock(sc);
+	bcd_tz_offset_encode(sc->buf, &b);
+	reg_write(sc, REG_TZ_OFFSET, sc->buf, bcd_tz_offset_len);
 
 	return 0;
 }
@@ -1522,24 +2503,19 @@ static int
 tsg_get_clock_phase_compensation(struct tsg_softc *sc, caddr_t arg)
 {
 	int32_t *argp = (int32_t *)arg;
-	char *fmt = "S c";
-	int16_t usec;
-	uint8_t hnsec;
+	struct phase_comp b;
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_PHASE_COMP, sc->buf, packlen(fmt));
-	unpack(sc->buf, fmt, &usec, &hnsec);
-	unlock(sc);
+	reg_read(sc, REG_PHASE_COMP, sc->buf, phase_comp_len);
+	phase_comp_decode(sc->buf, &b);
 
-	uprintf("usec=%d nsec=%d\n", usec, hnsec);
-	*argp = usec * 1000;
+	*argp = b.usec * 1000;
 	if (!sc->new_model)
 		return 0;
 
-	if (usec < 0)
-		*argp -= hnsec * 100;
+	if (b.usec < 0)
+		*argp -= b.hnsec * 100;
 	else
-		*argp += hnsec * 100;
+		*argp += b.hnsec * 100;
 	return 0;
 }
 
@@ -1547,17 +2523,14 @@ static int
 tsg_set_clock_phase_compensation_old(struct tsg_softc *sc, caddr_t arg)
 {
 	int32_t *argp = (int32_t *)arg;
-	int16_t usec;
-	char *fmt = "S";
+	struct phase_comp_old b;
 
-	usec = *argp / 1000;	// argp is in nanoseconds
-	if (usec < -1000 || usec > 1000)
+	b.usec = *argp / 1000;	// argp is in nanoseconds
+	if (b.usec < -1000 || b.usec > 1000)
 		return ENODEV;
 
-	lock(sc);
-	pack(sc->buf, fmt, usec);
-	bus_write_region_1(sc->registers_resource, REG_PHASE_COMP, sc->buf, packlen(fmt));
-	unlock(sc);
+	phase_comp_old_encode(sc->buf, &b);
+	reg_write(sc, REG_PHASE_COMP, sc->buf, phase_comp_old_len);
 
 	return 0;
 }
@@ -1566,22 +2539,20 @@ static int
 tsg_set_clock_phase_compensation_new(struct tsg_softc *sc, caddr_t arg)
 {
 	int32_t *argp = (int32_t *)arg;
-	int16_t usec;
+	struct phase_comp b;
 	int8_t hnsec;
-	char *fmt = "S c";
 
-	usec = *argp / 1000;	// argp is in nanoseconds
-	if (usec < -800 || usec > 800)
+	b.usec = *argp / 1000;	// argp is in nanoseconds
+	if (b.usec < -800 || b.usec > 800)
 		return ENODEV;
 
 	hnsec = (*argp % 1000) / 100;
 	if (hnsec < 0)
 		hnsec = -hnsec;
+	b.hnsec = hnsec;
 
-	lock(sc);
-	pack(sc->buf, fmt, usec, hnsec);
-	bus_write_region_1(sc->registers_resource, REG_PHASE_COMP, sc->buf, packlen(fmt));
-	unlock(sc);
+	phase_comp_encode(sc->buf, &b);
+	reg_write(sc, REG_PHASE_COMP, sc->buf, phase_comp_len);
 
 	return 0;
 }
@@ -1599,36 +2570,19 @@ static int
 tsg_get_timecode_quality(struct tsg_softc *sc, caddr_t arg)
 {
 	struct tsg_timecode_quality *argp = (struct tsg_timecode_quality *)arg;
-	char *fmt = "n";
+	struct tsg_telemetry t;
 	uint8_t buf;
 
 	if (!sc->new_model)
 		return EOPNOTSUPP;
+	if (telemetry_cached(sc, &t)) {
+		*argp = t.quality;
+		return 0;
+	}
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_TIMECODE_QUALITY, &buf, packlen(fmt));
-	unlock(sc);
+	reg_read(sc, REG_TIMECODE_QUALITY, &buf, 1);
 
-	unpack(&buf, fmt, &argp->level, &argp->locked);
-	argp->locked &= TSG_QUALITY_NOT_LOCKED;		// clear unrelated bits
-	argp->locked |= ~TSG_QUALITY_NOT_LOCKED;	// flip not locked bit
-	switch (argp->level) {
-	case 0x01:
-		argp->level = 1;
-		break;
-	case 0x02:
-		argp->level = 2;
-		break;
-	case 0x04:
-		argp->level = 3;
-		break;
-	case 0x08:
-		argp->level = 4;
-		break;
-	default:
-		argp->level = 0;
-		break;
-	}
+	decode_timecode_quality(buf, argp);
 	return 0;
 }
 
@@ -1640,11 +2594,7 @@ tsg_get_use_timecode_quality(struct tsg_softc *sc, caddr_t arg)
 	if (!sc->new_model)
 		return EOPNOTSUPP;
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_MISC_CONTROL, argp, 1);
-	unlock(sc);
-
-	*argp &= TSG_USE_TQ;
+	*argp = shadow_get(sc, &sc->misc_control, TSG_USE_TQ);
 	return 0;
 }
 
@@ -1652,19 +2602,14 @@ static int
 tsg_set_use_timecode_quality(struct tsg_softc *sc, caddr_t arg)
 {
 	uint8_t *argp = (uint8_t *)arg;
-	uint8_t buf;
 
 	if (!sc->new_model)
 		return EOPNOTSUPP;
 	if (*argp != 0 && *argp != TSG_USE_TQ)
 		return ENODEV;
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_MISC_CONTROL, &buf, 1);
-	buf &= TSG_INSERT_LEAP;	// clear all but the leap flag
-	buf |= *argp;		// set use TQ value
-	bus_write_region_1(sc->registers_resource, REG_MISC_CONTROL, &buf, 1);
-	unlock(sc);
+	// keeps the leap flag
+	shadow_set(sc, &sc->misc_control, TSG_USE_TQ, *argp);
 
 	return 0;
 }
@@ -1678,10 +2623,8 @@ tsg_get_synth_freq(struct tsg_softc *sc, caddr_t arg)
 	if (!sc->new_model)
 		return EOPNOTSUPP;
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_SYNTH_FREQ, sc->buf, packlen(fmt));
+	reg_read(sc, REG_SYNTH_FREQ, sc->buf, packlen(fmt));
 	unpack(sc->buf, fmt, argp);
-	unlock(sc);
 
 	return 0;
 }
@@ -1697,14 +2640,11 @@ tsg_set_synth_freq(struct tsg_softc *sc, caddr_t arg)
 	if (*argp < 1 || *argp > 1000000)
 		return EINVAL;
 
-	lock(sc);
 	pack(sc->buf, fmt, *argp);
-	bus_write_region_1(sc->registers_resource, REG_SYNTH_FREQ, sc->buf, packlen(fmt));
+	reg_write(sc, REG_SYNTH_FREQ, sc->buf, packlen(fmt));
 
-	bus_read_region_1(sc->registers_resource, REG_SYNTH_CONTROL, sc->buf, 1);
-	sc->buf[0] |= TSG_SYNTH_LOAD;
-	bus_write_region_1(sc->registers_resource, REG_SYNTH_CONTROL, sc->buf, 1);
-	unlock(sc);
+	shadow_set(sc, &sc->synth_control, TSG_SYNTH_LOAD, TSG_SYNTH_LOAD);
+	update_edge_grid(sc);
 	return 0;
 }
 
@@ -1712,15 +2652,11 @@ static int
 tsg_get_synth_edge(struct tsg_softc *sc, caddr_t arg)
 {
 	uint8_t *argp = (uint8_t *)arg;
-	uint8_t buf;
 
 	if (!sc->new_model)
 		return EOPNOTSUPP;
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_SYNTH_CONTROL, &buf, 1);
-	unlock(sc);
-	*argp = buf & TSG_SYNTH_EDGE_RISING;
+	*argp = shadow_get(sc, &sc->synth_control, TSG_SYNTH_EDGE_RISING);
 	return 0;
 }
 
@@ -1728,19 +2664,14 @@ static int
 tsg_set_synth_edge(struct tsg_softc *sc, caddr_t arg)
 {
 	uint8_t *argp = (uint8_t *)arg;
-	uint8_t buf;
 
 	if (!sc->new_model)
 		return EOPNOTSUPP;
 	if (*argp != 0 && *argp != TSG_SYNTH_EDGE_RISING)
 		return EINVAL;
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_SYNTH_CONTROL, &buf, 1);
-	buf &= ~TSG_SYNTH_EDGE_RISING;
-	buf |= *argp;
-	bus_write_region_1(sc->registers_resource, REG_SYNTH_CONTROL, &buf, 1);
-	unlock(sc);
+	shadow_set(sc, &sc->synth_control, TSG_SYNTH_EDGE_RISING, *argp);
+	update_edge_grid(sc);
 	return 0;
 }
 
@@ -1752,10 +2683,7 @@ tsg_get_synth_enable(struct tsg_softc *sc, caddr_t arg)
 	if (!sc->new_model)
 		return EOPNOTSUPP;
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_SYNTH_CONTROL, argp, 1);
-	unlock(sc);
-	*argp &= TSG_SYNTH_ENABLE;
+	*argp = shadow_get(sc, &sc->synth_control, TSG_SYNTH_ENABLE);
 	return 0;
 }
 
@@ -1763,74 +2691,112 @@ static int
 tsg_set_synth_enable(struct tsg_softc *sc, caddr_t arg)
 {
 	uint8_t *argp = (uint8_t *)arg;
-	uint8_t buf;
 
 	if (!sc->new_model)
 		return EOPNOTSUPP;
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_SYNTH_CONTROL, &buf, 1);
-	buf &= ~TSG_SYNTH_ENABLE;
-	buf |= *argp;
-	bus_write_region_1(sc->registers_resource, REG_SYNTH_CONTROL, &buf, 1);
-	unlock(sc);
+	shadow_set(sc, &sc->synth_control, TSG_SYNTH_ENABLE, *argp);
 	return 0;
 }
 
+static uint32_t
+pulse_period(uint8_t freq)
+{
+	switch (freq) {
+	case TSG_PULSE_FREQ_1HZ:
+		return 1000000000;
+	case TSG_PULSE_FREQ_10HZ:
+		return 100000000;
+	case TSG_PULSE_FREQ_100HZ:
+		return 10000000;
+	case TSG_PULSE_FREQ_1KHZ:
+		return 1000000;
+	case TSG_PULSE_FREQ_10KHZ:
+		return 100000;
+	case TSG_PULSE_FREQ_100KHZ:
+		return 10000;
+	case TSG_PULSE_FREQ_1MHZ:
+		return 1000;
+	case TSG_PULSE_FREQ_5MHZ:
+		return 200;
+	case TSG_PULSE_FREQ_10MHZ:
+		return 100;
+	default:
+		return 0;
+	}
+}
+
+// Work out where pulse and synth edges fall in each board second, so the
+// ithread can reconstruct edge times. Called at attach and whenever the
+// pulse or synth configuration changes.
+static void
+update_edge_grid(struct tsg_softc *sc)
+{
+	uint32_t pulse = 0, synth = 0, phase = 0;
+	uint32_t freq;
+	uint8_t v;
+
+	if (tsg_get_pulse_freq(sc, (caddr_t)&v) == 0)
+		pulse = pulse_period(v);
+	if (tsg_get_synth_freq(sc, (caddr_t)&freq) == 0 && freq != 0 && 1000000000 % freq == 0) {
+		synth = 1000000000 / freq;
+		// the interrupt is on the rising edge; when the falling edge
+		// is the on time one, the rising edge is half a period later
+		tsg_get_synth_edge(sc, (caddr_t)&v);
+		if (v != TSG_SYNTH_EDGE_RISING)
+			phase = synth / 2;
+	}
+
+	mtx_lock_spin(&sc->latch_mtx);
+	sc->sources[SRC_PULSE].period = pulse;
+	sc->sources[SRC_SYNTH].period = synth;
+	sc->sources[SRC_SYNTH].phase = phase;
+	mtx_unlock_spin(&sc->latch_mtx);
+}
+
 static int
 tsg_get_compare_time(struct tsg_softc *sc, caddr_t arg)
 {
 	struct tsg_compare_time *argp = (struct tsg_compare_time *)arg;
-	char *fmt = "nnnn nnnn";
-	uint8_t hundreds_day, tens_day, units_day;
-	uint8_t tens_hour, units_hour;
-	uint8_t tens_min, units_min;
-	uint8_t tens_sec, units_sec;
-	uint8_t hundreds_msec, tens_msec, units_msec;
-	uint8_t hundreds_usec, tens_usec, units_usec;
-	uint8_t mask;
+	struct bcd_compare b;
 
-	lock(sc);
-	bus_read_region_1(sc->registers_resource, REG_TIME_COMPARE, sc->buf, packlen(fmt));
-	unpack(sc->buf, fmt,
-		&tens_usec,	&units_usec,
-		&units_msec,	&hundreds_usec,
-		&hundreds_msec,	&tens_msec,
-		&tens_sec,	&units_sec,
-		&tens_min,	&units_min,
-		&tens_hour,	&units_hour,
-		&tens_day,	&units_day,
-		&mask,		&hundreds_day
-	);
-	unlock(sc);
+	reg_read(sc, REG_TIME_COMPARE, sc->buf, bcd_compare_len);
+	bcd_compare_decode(sc->buf, &b);
 
-	argp->day = hundreds_day * 100 + tens_day * 10 + units_day;
-	argp->hour = tens_hour * 10 + units_hour;
-	argp->min = tens_min * 10 + units_min;
-	argp->sec = tens_sec * 10 + units_sec;
+	argp->day = b.hundreds_day * 100 + b.tens_day * 10 + b.units_day;
+	argp->hour = b.tens_hour * 10 + b.units_hour;
+	argp->min = b.tens_min * 10 + b.units_min;
+	argp->sec = b.tens_sec * 10 + b.units_sec;
 	argp->usec =
-		hundreds_msec * 100000 +
-		tens_msec *      10000 +
-		units_msec *      1000 +
-		hundreds_usec *    100 +
-		tens_usec *         10 +
-		units_usec;
-	argp->mask = mask;
+		b.hundreds_msec * 100000 +
+		b.tens_msec *      10000 +
+		b.units_msec *      1000 +
+		b.hundreds_usec *    100 +
+		b.tens_usec *         10 +
+		b.units_usec;
+	argp->mask = b.mask;
 
 	return 0;
 }
 
+// Write the time compare register. The caller holds cmp_mtx.
+static void
+write_compare(struct tsg_softc *sc, struct tsg_busacct *acct, uint16_t day, uint8_t hour,
+    uint8_t min, uint8_t sec, uint32_t usec, uint8_t mask)
+{
+	uint8_t buf[bcd_compare_len];
+
+	mtx_assert(&sc->cmp_mtx, MA_OWNED);
+	bcdtime_encode_compare(buf, day, hour, min, sec, usec, mask);
+	reg_out(sc, acct, REG_TIME_COMPARE, buf, bcd_compare_len);
+}
+
+// the register belongs to TSG_WAIT_UNTIL while anyone is sleeping
 static int
 tsg_set_compare_time(struct tsg_softc *sc, caddr_t arg)
 {
 	struct tsg_compare_time *argp = (struct tsg_compare_time *)arg;
-	char *fmt = "nnnn nnnn";
-	uint8_t hundreds_day, tens_day, units_day;
-	uint8_t tens_hour, units_hour;
-	uint8_t tens_min, units_min;
-	uint8_t tens_sec, units_sec;
-	uint8_t hundreds_msec, tens_msec, units_msec;
-	uint8_t hundreds_usec, tens_usec, units_usec;
+	int error = 0;
 
 	if (argp->day < 1 || argp->day > 366)
 		return EINVAL;
@@ -1864,27 +2830,331 @@ tsg_set_compare_time(struct tsg_softc *sc, caddr_t arg)
 		return EINVAL;
 	}
 
-	ushort2bcd(argp->day, NULL, NULL, &hundreds_day, &tens_day, &units_day);
-	ushort2bcd(argp->hour, NULL, NULL, NULL, &tens_hour, &units_hour);
-	ushort2bcd(argp->min, NULL, NULL, NULL, &tens_min, &units_min);
-	ushort2bcd(argp->sec, NULL, NULL, NULL, &tens_sec, &units_sec);
-	ushort2bcd(argp->usec / 1000, NULL, NULL, &hundreds_msec, &tens_msec, &units_msec);
-	ushort2bcd(argp->usec % 1000, NULL, NULL, &hundreds_usec, &tens_usec, &units_usec);
+	mtx_lock(&sc->cmp_mtx);
+	if (sc->cmpq.n > 0)
+		error = EBUSY;
+	else {
+		write_compare(sc, sc->bus_acct, argp->day, argp->hour, argp->min,
+		    argp->sec, argp->usec, argp->mask);
+		sc->cmpq.armed = 0;
+	}
+	mtx_unlock(&sc->cmp_mtx);
 
-	lock(sc);
-	pack(sc->buf, fmt,
-		tens_usec,	units_usec,
-		units_msec,	hundreds_usec,
-		hundreds_msec,	tens_msec,
-		tens_sec,	units_sec,
-		tens_min,	units_min,
-		tens_hour,	units_hour,
-		tens_day,	units_day,
-		argp->mask,	hundreds_day
-	);
-	bus_write_region_1(sc->registers_resource, REG_TIME_COMPARE, sc->buf, packlen(fmt));
-	unlock(sc);
+	return error;
+}
+
+// Set the interrupt mask to intmask_user | intmask_wait. Both are
+// changed with latch_mtx held, so the LCR enable is done under it too.
+static void
+write_intmask(struct tsg_softc *sc, struct tsg_busacct *acct)
+{
+	mtx_assert(&sc->latch_mtx, MA_OWNED);
+	sc->intmask = sc->intmask_user | sc->intmask_wait;
+	reg_out(sc, acct, REG_HARDWARE_CONTROL, &sc->intmask, 1);
+	tsg_intcsr(sc, sc->intmask != 0);
+}
 
+// cmpq_ops for the board. The time is only latched when tsg_filter has
+// nothing latched: waiting for tsg_ithrd to collect it could deadlock,
+// since the ithread may itself be waiting for cmp_mtx. Time 0 instead
+// wakes nobody, and the ithread runs the queue again once it is clear.
+static uint64_t
+cmp_now(void *arg)
+{
+	struct tsg_softc *sc = arg;
+	uint8_t buf[sizeof(sc->buf)];
+	uint8_t latch = 0;
+	struct tsg_time t;
+
+	mtx_lock_spin(&sc->latch_mtx);
+	if (sc->pending != 0) {
+		sc->cmp_rerun = true;
+		mtx_unlock_spin(&sc->latch_mtx);
+		return 0;
+	}
+	reg_out(sc, &sc->bus_cmpq, 0xfc, &latch, 1);
+	read_bcd_time(sc, &sc->bus_cmpq, buf);
+	mtx_unlock_spin(&sc->latch_mtx);
+
+	bcdtime_decode(buf, sc->new_model, &t);
+	sc->cmp_time = CMPQ_KEY(t.year, t.day, t.hour, t.min, t.sec, t.nsec / 1000);
+	return sc->cmp_time;
+}
+
+// The register has no year, so a deadline a year or more away fires
+// early; cmpq_run finds it isn't due yet and leaves it armed.
+static void
+cmp_arm(void *arg, uint64_t when)
+{
+	struct tsg_softc *sc = arg;
+	uint32_t usec = when % 1000000;
+	uint8_t sec, min, hour;
+	uint16_t day;
+
+	when /= 1000000;
+	sec = when % 60;
+	when /= 60;
+	min = when % 60;
+	when /= 60;
+	hour = when % 24;
+	when /= 24;
+	day = when % 367;
+
+	// enable the interrupt first; a stale match only costs a spurious run
+	if ((sc->intmask_wait & TSG_INT_ENABLE_COMPARE) == 0) {
+		mtx_lock_spin(&sc->latch_mtx);
+		sc->intmask_wait = TSG_INT_ENABLE_COMPARE;
+		write_intmask(sc, &sc->bus_cmpq);
+		mtx_unlock_spin(&sc->latch_mtx);
+	}
+	write_compare(sc, &sc->bus_cmpq, day, hour, min, sec, usec, TSG_COMPARE_MASK_HDAY);
+}
+
+static void
+cmp_wake(void *arg, struct cmpq_waiter *w)
+{
+	struct tsg_softc *sc = arg;
+
+	if (w == &sc->sched_w)
+		sched_fire(sc);
+	else
+		wakeup(w);
+}
+
+static const struct cmpq_ops cmp_ops = { cmp_now, cmp_arm, cmp_wake };
+
+// wake the sleepers that are due and rearm for the rest; once there are
+// none, drop the compare interrupt unless TSG_SET_INT_MASK asked for it
+static void
+cmp_run(struct tsg_softc *sc)
+{
+	mtx_assert(&sc->cmp_mtx, MA_OWNED);
+	sc->bus_cmpq.calls++;
+	sc->cmp_rerun = false;
+	cmpq_run(&sc->cmpq, &cmp_ops, sc);
+	if (sc->cmpq.n == 0 && sc->intmask_wait != 0) {
+		mtx_lock_spin(&sc->latch_mtx);
+		sc->intmask_wait = 0;
+		write_intmask(sc, &sc->bus_cmpq);
+		mtx_unlock_spin(&sc->latch_mtx);
+	}
+}
+
+// wake every sleeper and make them return ENXIO
+static void
+cmp_shutdown(struct tsg_softc *sc)
+{
+	struct cmpq_waiter *w;
+
+	mtx_lock(&sc->cmp_mtx);
+	sc->cmp_gone = true;
+	while (sc->cmpq.n > 0) {
+		w = sc->cmpq.heap[0];
+		cmpq_remove(&sc->cmpq, w);
+		wakeup(w);
+	}
+	mtx_unlock(&sc->cmp_mtx);
+}
+
+// a time the compare register can be armed for
+static bool
+time_valid(struct tsg_time *t)
+{
+	return t->day >= 1 && t->day <= 366 && t->hour <= 23 && t->min <= 59 &&
+	    t->sec <= 59 && t->nsec <= 999999999;
+}
+
+static uint64_t
+time_key(struct tsg_time *t)
+{
+	return CMPQ_KEY(t->year, t->day, t->hour, t->min, t->sec, t->nsec / 1000);
+}
+
+// Not in tsg_ioctls: it sleeps, and must not hold cfg_lock while it does.
+static int
+tsg_wait_until(struct tsg_softc *sc, struct tsg_time *t)
+{
+	struct cmpq_waiter w;
+	int error = 0;
+
+	if (!time_valid(t))
+		return EINVAL;
+	w.when = time_key(t);
+
+	mtx_lock(&sc->cmp_mtx);
+	if (sc->cmp_gone)
+		error = ENXIO;
+	else if (cmpq_insert(&sc->cmpq, &w) != 0)
+		error = EAGAIN;
+	else {
+		cmp_run(sc);
+		while (w.slot >= 0 && error == 0)
+			error = msleep(&w, &sc->cmp_mtx, PCATCH, "tsgwait", 0);
+		if (error != 0) {
+			// rearm for the rest, or drop the compare interrupt
+			cmpq_remove(&sc->cmpq, &w);
+			if (!sc->cmp_gone)
+				cmp_run(sc);
+		} else if (sc->cmp_gone)
+			error = ENXIO;
+	}
+	mtx_unlock(&sc->cmp_mtx);
+	return error;
+}
+
+// Queue the schedule's next strobe, or finish. There is always room, as
+// this only runs when the schedule has just been taken off cmpq.
+static void
+sched_queue(struct tsg_softc *sc)
+{
+	mtx_assert(&sc->cmp_mtx, MA_OWNED);
+	if (sc->sched_left == 0 && !sc->sched_forever) {
+		sc->sched_state = TSG_SCHEDULE_DONE;
+		return;
+	}
+	sc->sched_w.when = time_key(&sc->sched_time);
+	cmpq_insert(&sc->cmpq, &sc->sched_w);
+}
+
+// microseconds from year 0 to a CMPQ_KEY, which leaves a gap after the
+// last day of each year
+static uint64_t
+key_usec(uint64_t key)
+{
+	uint64_t usec = key % (86400 * 1000000ULL);
+	uint64_t day = key / (86400 * 1000000ULL);
+	uint64_t year = day / 367;
+
+	// days before year, counting leap years from year 0
+	day = day % 367 + 365 * year + (year + 3) / 4 - (year + 99) / 100 + (year + 399) / 400;
+	return day * 86400 * 1000000ULL + usec;
+}
+
+// Called by cmpq_run when the strobe is due. If the register was armed for
+// it in time, the board fired it; otherwise it had passed before its turn
+// came, usually because the one before was too close, or while the
+// register was being written.
+//
+// A periodic schedule whose next strobe has also passed, because it
+// started in the past or the board time jumped, skips the strobes up to
+// the board time cmpq_run is working from and counts them as missed.
+// Stepping through them one at a time could take billions of turns.
+static void
+sched_fire(struct tsg_softc *sc)
+{
+	uint64_t behind, skip;
+
+	if (sc->sched_w.when == sc->cmpq.armed && !sc->cmpq.late) {
+		if (sc->sched_fired < UINT32_MAX)
+			sc->sched_fired++;
+	} else if (sc->sched_missed < UINT32_MAX)
+		sc->sched_missed++;
+	if (!sc->sched_forever)
+		sc->sched_left--;
+	if (sc->sched_period != 0) {
+		time_add_usec(&sc->sched_time, sc->sched_period);
+		if (time_key(&sc->sched_time) <= sc->cmp_time &&
+		    (sc->sched_left > 0 || sc->sched_forever)) {
+			behind = key_usec(sc->cmp_time) - key_usec(time_key(&sc->sched_time));
+			skip = behind / sc->sched_period + 1;
+			if (!sc->sched_forever)
+				skip = MIN(skip, sc->sched_left);
+			sc->sched_missed = MIN(sc->sched_missed + skip, UINT32_MAX);
+			if (!sc->sched_forever)
+				sc->sched_left -= skip;
+			time_add_usec(&sc->sched_time, skip * sc->sched_period);
+		}
+	} else if (sc->sched_left > 0)
+		sc->sched_time = sc->sched_times[sc->sched_count - sc->sched_left];
+	sched_queue(sc);
+}
+
+// stop the running schedule; returns the list for the caller to free
+static struct tsg_time *
+sched_stop(struct tsg_softc *sc)
+{
+	struct tsg_time *times = sc->sched_times;
+
+	mtx_assert(&sc->cmp_mtx, MA_OWNED);
+	cmpq_remove(&sc->cmpq, &sc->sched_w);
+	sc->sched_times = NULL;
+	sc->sched_count = 0;
+	sc->sched_period = 0;
+	sc->sched_forever = false;
+	sc->sched_left = 0;
+	return times;
+}
+
+static int
+tsg_set_schedule(struct tsg_softc *sc, caddr_t arg)
+{
+	struct tsg_schedule *argp = (struct tsg_schedule *)arg;
+	struct tsg_time *times = NULL;
+	uint32_t i;
+	int error = 0;
+
+	if (argp->count > TSG_SCHEDULE_MAX)
+		return EINVAL;
+	if (argp->count > 0) {
+		times = malloc(argp->count * sizeof(*times), M_DEVBUF, M_WAITOK);
+		error = copyin((void *)(uintptr_t)argp->times, times, argp->count * sizeof(*times));
+		for (i = 0; i < argp->count && error == 0; ++i)
+			if (!time_valid(&times[i]) ||
+			    (i > 0 && time_key(&times[i]) <= time_key(&times[i - 1])))
+				error = EINVAL;
+	} else if (argp->period != 0) {
+		if (!time_valid(&argp->start) || argp->period < TSG_SCHEDULE_MIN_PERIOD)
+			error = EINVAL;
+	}
+	if (error != 0) {
+		free(times, M_DEVBUF);
+		return error;
+	}
+
+	mtx_lock(&sc->cmp_mtx);
+	free(sched_stop(sc), M_DEVBUF);
+	sc->sched_state = TSG_SCHEDULE_IDLE;
+	if (argp->count > 0) {
+		sc->sched_times = times;
+		sc->sched_count = argp->count;
+		sc->sched_left = argp->count;
+		sc->sched_time = times[0];
+	} else if (argp->period != 0) {
+		sc->sched_period = argp->period;
+		sc->sched_forever = argp->repeat == 0;
+		sc->sched_left = argp->repeat;
+		sc->sched_time = argp->start;
+	}
+	if (sc->sched_count > 0 || sc->sched_period != 0) {
+		if (sc->cmpq.n == CMPQ_MAX) {
+			free(sched_stop(sc), M_DEVBUF);
+			error = EAGAIN;
+		} else {
+			sc->sched_state = TSG_SCHEDULE_RUNNING;
+			sc->sched_fired = sc->sched_missed = 0;
+			sched_queue(sc);
+		}
+	}
+	cmp_run(sc);
+	mtx_unlock(&sc->cmp_mtx);
+	return error;
+}
+
+static int
+tsg_get_schedule(struct tsg_softc *sc, caddr_t arg)
+{
+	struct tsg_schedule_status *argp = (struct tsg_schedule_status *)arg;
+
+	memset(argp, 0, sizeof(*argp));
+	mtx_lock(&sc->cmp_mtx);
+	argp->state = sc->sched_state;
+	argp->fired = sc->sched_fired;
+	argp->missed = sc->sched_missed;
+	if (sc->sched_state == TSG_SCHEDULE_RUNNING) {
+		argp->left = sc->sched_forever ? 0 : sc->sched_left;
+		argp->next = sc->sched_time;
+	}
+	mtx_unlock(&sc->cmp_mtx);
 	return 0;
 }
 
@@ -1893,9 +3163,7 @@ tsg_get_int_mask(struct tsg_softc *sc, caddr_t arg)
 {
 	uint8_t *argp = (uint8_t *)arg;
 
-	lock(sc);
-	*argp = sc->intmask;
-	unlock(sc);
+	*argp = sc->intmask_user;
 
 	return 0;
 }
@@ -1909,170 +3177,581 @@ tsg_set_int_mask(struct tsg_softc *sc, caddr_t arg)
 		return EINVAL;	// non-int bits are set
 	if (!sc->new_model && (*argp & TSG_INT_ENABLE_SYNTH))
 		return ENODEV;	// old boards don't support synth interrupts
+	if (bench_running(sc))
+		return EBUSY;
+
+	mtx_lock_spin(&sc->latch_mtx);
+	sc->intmask_user = *argp;
+	write_intmask(sc, sc->bus_acct);
+	mtx_unlock_spin(&sc->latch_mtx);
+
+	return 0;
+}
+
+// Interrupt latency benchmark. The pulse frequency and interrupt mask are
+// set before the benchmark is marked running, and put back after it has
+// stopped, since the setters refuse to change them while it runs.
+static int
+tsg_start_bench(struct tsg_softc *sc, caddr_t arg)
+{
+	struct tsg_bench_config *argp = (struct tsg_bench_config *)arg;
+	uint8_t mask;
+	int error;
+
+	switch (argp->freq) {
+	case TSG_PULSE_FREQ_1HZ:
+	case TSG_PULSE_FREQ_10HZ:
+	case TSG_PULSE_FREQ_100HZ:
+	case TSG_PULSE_FREQ_1KHZ:
+	case TSG_PULSE_FREQ_10KHZ:
+		break;
+	default:
+		return EINVAL;
+	}
+	if (argp->seconds == 0 || argp->seconds > TSG_BENCH_MAX_SECONDS)
+		return EINVAL;
+	if (bench_running(sc))
+		return EBUSY;
+
+	tsg_get_pulse_freq(sc, (caddr_t)&sc->bench_saved_freq);
+	sc->bench_saved_intmask = sc->intmask_user;
+	if ((error = tsg_set_pulse_freq(sc, (caddr_t)&argp->freq)) != 0)
+		return error;
+	mask = sc->intmask_user | TSG_INT_ENABLE_PULSE;
+	if ((error = tsg_set_int_mask(sc, (caddr_t)&mask)) != 0) {
+		tsg_set_pulse_freq(sc, (caddr_t)&sc->bench_saved_freq);
+		return error;
+	}
+
+	mtx_lock(&sc->notify_mtx);
+	memset(sc->bench_hist, 0, TSG_BENCH_BINS * sizeof(*sc->bench_hist));
+	sc->bench_samples = 0;
+	sc->bench_min = UINT32_MAX;
+	sc->bench_max = 0;
+	sc->bench_freq = argp->freq;
+	sc->bench_seconds = argp->seconds;
+	sc->bench_state = TSG_BENCH_RUNNING;
+	mtx_unlock(&sc->notify_mtx);
+
+	taskqueue_enqueue_timeout(taskqueue_thread, &sc->bench_task, argp->seconds * hz);
+	return 0;
+}
+
+static void
+tsg_bench_finish(void *arg, int pending)
+{
+	struct tsg_softc *sc = arg;
 
 	lock(sc);
-	sc->intmask = *argp;
-	bus_write_region_1(sc->registers_resource, REG_HARDWARE_CONTROL, &sc->intmask, 1);
-	tsg_intcsr(sc, sc->intmask != 0);
+	mtx_lock(&sc->notify_mtx);
+	sc->bench_state = TSG_BENCH_DONE;
+	mtx_unlock(&sc->notify_mtx);
+	tsg_set_pulse_freq(sc, (caddr_t)&sc->bench_saved_freq);
+	tsg_set_int_mask(sc, (caddr_t)&sc->bench_saved_intmask);
 	unlock(sc);
+}
+
+// the upper edge of the bin holding the pct'th percentile, but no more than max
+static uint32_t
+bench_percentile(struct tsg_softc *sc, int pct)
+{
+	uint64_t rank, n = 0;
+	int i;
+
+	mtx_assert(&sc->notify_mtx, MA_OWNED);
+	rank = (sc->bench_samples * pct + 99) / 100;
+	for (i = 0; i < TSG_BENCH_BINS - 1; ++i) {
+		n += sc->bench_hist[i];
+		if (n >= rank)
+			break;
+	}
+	return MIN((i + 1) * TSG_BENCH_BIN_NS, sc->bench_max);
+}
 
+static int
+tsg_get_bench(struct tsg_softc *sc, caddr_t arg)
+{
+	struct tsg_bench_result *argp = (struct tsg_bench_result *)arg;
+
+	memset(argp, 0, sizeof(*argp));
+	mtx_lock(&sc->notify_mtx);
+	argp->state = sc->bench_state;
+	argp->freq = sc->bench_freq;
+	argp->seconds = sc->bench_seconds;
+	argp->samples = sc->bench_samples;
+	if (sc->bench_samples != 0) {
+		argp->min_ns = sc->bench_min;
+		argp->p50_ns = bench_percentile(sc, 50);
+		argp->p99_ns = bench_percentile(sc, 99);
+		argp->max_ns = sc->bench_max;
+	}
+	mtx_unlock(&sc->notify_mtx);
 	return 0;
 }
 
+// Fill in everything a monitor usually wants at once. Getters that
+// don't apply to this board fail and leave their fields zero.
+static int
+tsg_get_status(struct tsg_softc *sc, caddr_t arg)
+{
+	struct tsg_status *argp = (struct tsg_status *)arg;
+
+	memset(argp, 0, sizeof(*argp));
+	tsg_get_board_model(sc, (caddr_t)&argp->model);
+	tsg_get_board_firmware(sc, (caddr_t)&argp->firmware);
+	tsg_get_board_test_status(sc, (caddr_t)&argp->test_status);
+	tsg_get_clock_lock(sc, (caddr_t)&argp->lock);
+	tsg_get_clock_ref(sc, (caddr_t)&argp->ref);
+	tsg_get_clock_timecode(sc, (caddr_t)&argp->timecode);
+	tsg_get_clock_dac(sc, (caddr_t)&argp->dac);
+	tsg_get_clock_leap(sc, (caddr_t)&argp->leap);
+	tsg_get_clock_dst(sc, (caddr_t)&argp->dst);
+	tsg_get_clock_stop(sc, (caddr_t)&argp->stop);
+	tsg_get_use_timecode_quality(sc, (caddr_t)&argp->use_quality);
+	tsg_get_timecode_quality(sc, (caddr_t)&argp->quality);
+	tsg_get_gps_antenna_status(sc, (caddr_t)&argp->antenna);
+	tsg_get_int_mask(sc, (caddr_t)&argp->intmask);
+	tsg_get_clock_time(sc, (caddr_t)&argp->time);
+	return 0;
+}
+
+typedef int (*tsg_handler)(struct tsg_softc *, caddr_t);
+
+// Every command is in group 'T', so the table is indexed by the command
+// number and a lookup is a single compare. Unused slots have cmd 0.
+#define	TSG_NCMDS	256
+#define	TSG_CMDNUM(cmd)	(IOCBASECMD(cmd) & 0xff)
+#define	TSG_IOCTLS(X)												\
+	X(TSG_GET_BOARD_MODEL,		tsg_get_board_model,			"get_board_model")		\
+	X(TSG_GET_BOARD_FIRMWARE,	tsg_get_board_firmware,			"get_board_firmware")		\
+	X(TSG_GET_BOARD_TEST_STATUS,	tsg_get_board_test_status,		"get_board_test_status")	\
+	X(TSG_GET_BOARD_J1,		tsg_get_board_j1,			"get_board_j1")			\
+	X(TSG_SET_BOARD_J1,		tsg_set_board_j1,			"set_board_j1")			\
+	X(TSG_GET_BOARD_PIN6,		tsg_get_board_pin6,			"get_board_pin6")		\
+	X(TSG_SET_BOARD_PIN6,		tsg_set_board_pin6,			"set_board_pin6")		\
+	X(TSG_GET_PULSE_FREQ,		tsg_get_pulse_freq,			"get_pulse_freq")		\
+	X(TSG_SET_PULSE_FREQ,		tsg_set_pulse_freq,			"set_pulse_freq")		\
+	X(TSG_GET_GPS_ANTENNA_STATUS,	tsg_get_gps_antenna_status,		"get_gps_antenna_status")	\
+	X(TSG_GET_CLOCK_LOCK,		tsg_get_clock_lock,			"get_clock_lock")		\
+	X(TSG_GET_CLOCK_TIMECODE,	tsg_get_clock_timecode,			"get_clock_timecode")		\
+	X(TSG_SET_CLOCK_TIMECODE,	tsg_set_clock_timecode,			"set_clock_timecode")		\
+	X(TSG_GET_CLOCK_REF,		tsg_get_clock_ref,			"get_clock_ref")		\
+	X(TSG_SET_CLOCK_REF,		tsg_set_clock_ref,			"set_clock_ref")		\
+	X(TSG_GET_CLOCK_TIME,		tsg_get_clock_time,			"get_clock_time")		\
+	X(TSG_SET_CLOCK_TIME,		tsg_set_clock_time,			"set_clock_time")		\
+	X(TSG_GET_CLOCK_PRESET,		tsg_get_clock_preset,			"get_clock_preset")		\
+	X(TSG_GET_CLOCK_OFFSET,		tsg_get_clock_offset,			"get_clock_offset")		\
+	X(TSG_GET_CLOCK_TIME_CYCLES,	tsg_get_clock_time_cycles,		"get_clock_time_cycles")	\
+	X(TSG_GET_GPS_POSITION,		tsg_get_gps_position,			"get_gps_position")		\
+	X(TSG_GET_GPS_SIGNAL,		tsg_get_gps_signal,			"get_gps_signal")		\
+	X(TSG_GET_TIMECODE_AGC_DELAYS,	tsg_get_timecode_agc_delays,		"get_timecode_agc_delays")	\
+	X(TSG_GET_CLOCK_LEAP,		tsg_get_clock_leap,			"get_clock_leap")		\
+	X(TSG_SET_CLOCK_LEAP,		tsg_set_clock_leap,			"set_clock_leap")		\
+	X(TSG_GET_CLOCK_DAC,		tsg_get_clock_dac,			"get_clock_dac")		\
+	X(TSG_SAVE_CLOCK_DAC,		tsg_save_clock_dac,			"save_clock_dac")		\
+	X(TSG_GET_CLOCK_DST,		tsg_get_clock_dst,			"get_clock_dst")		\
+	X(TSG_SET_CLOCK_DST,		tsg_set_clock_dst,			"set_clock_dst")		\
+	X(TSG_GET_CLOCK_STOP,		tsg_get_clock_stop,			"get_clock_stop")		\
+	X(TSG_SET_CLOCK_STOP,		tsg_set_clock_stop,			"set_clock_stop")		\
+	X(TSG_GET_CLOCK_TZ_OFFSET,	tsg_get_clock_tz_offset,		"get_clock_tz_offset")		\
+	X(TSG_SET_CLOCK_TZ_OFFSET,	tsg_set_clock_tz_offset,		"set_clock_tz_offset")		\
+	X(TSG_GET_CLOCK_PHASE_COMP,	tsg_get_clock_phase_compensation,	"get_clock_phase_compensation")	\
+	X(TSG_SET_CLOCK_PHASE_COMP,	tsg_set_clock_phase_compensation,	"set_clock_phase_compensation")	\
+	X(TSG_GET_TIMECODE_QUALITY,	tsg_get_timecode_quality,		"get_timecode_quality")		\
+	X(TSG_GET_USE_TIMECODE_QUALITY,	tsg_get_use_timecode_quality,		"get_use_timecode_quality")	\
+	X(TSG_SET_USE_TIMECODE_QUALITY,	tsg_set_use_timecode_quality,		"set_use_timecode_quality")	\
+	X(TSG_GET_SYNTH_FREQ,		tsg_get_synth_freq,			"get_synth_freq")		\
+	X(TSG_SET_SYNTH_FREQ,		tsg_set_synth_freq,			"set_synth_freq")		\
+	X(TSG_GET_SYNTH_EDGE,		tsg_get_synth_edge,			"get_synth_edge")		\
+	X(TSG_SET_SYNTH_EDGE,		tsg_set_synth_edge,			"set_synth_edge")		\
+	X(TSG_GET_SYNTH_ENABLE,		tsg_get_synth_enable,			"get_synth_enable")		\
+	X(TSG_SET_SYNTH_ENABLE,		tsg_set_synth_enable,			"set_synth_enable")		\
+	X(TSG_GET_COMPARE_TIME,		tsg_get_compare_time,			"get_compare_time")		\
+	X(TSG_SET_COMPARE_TIME,		tsg_set_compare_time,			"set_compare_time")		\
+	X(TSG_SET_SCHEDULE,		tsg_set_schedule,			"set_schedule")			\
+	X(TSG_GET_SCHEDULE,		tsg_get_schedule,			"get_schedule")			\
+	X(TSG_GET_INT_MASK,		tsg_get_int_mask,			"get_int_mask")			\
+	X(TSG_SET_INT_MASK,		tsg_set_int_mask,			"set_int_mask")			\
+	X(TSG_GET_WATCH_INTERVAL,	tsg_get_watch_interval,			"get_watch_interval")		\
+	X(TSG_SET_WATCH_INTERVAL,	tsg_set_watch_interval,			"set_watch_interval")		\
+	X(TSG_GET_TELEMETRY,		tsg_get_telemetry,			"get_telemetry")		\
+	X(TSG_GET_TELEMETRY_HISTORY,	tsg_get_telemetry_history,		"get_telemetry_history")	\
+	X(TSG_GET_STATUS,		tsg_get_status,				"get_status")			\
+	X(TSG_START_BENCH,		tsg_start_bench,			"start_bench")			\
+	X(TSG_GET_BENCH,		tsg_get_bench,				"get_bench")
+
+static struct tsg_ioctl {
+	u_long		cmd;
+	tsg_handler	fcn;
+	const char	*name;		// for sysctl
+} tsg_ioctls[TSG_NCMDS] = {
+#define	IOCTL(cmd, fcn, name)	[TSG_CMDNUM(cmd)] = { cmd, fcn, name },
+	TSG_IOCTLS(IOCTL)
+};
+
+// Two commands with the same number would silently share a slot above;
+// as case labels they fail to compile instead. The commands tsg_ioctl()
+// handles itself must not collide with the table either.
+static __unused void
+tsg_ioctls_unique(void)
+{
+#define	CMDCASE(cmd, fcn, name)	case TSG_CMDNUM(cmd):
+	switch (0) {
+	TSG_IOCTLS(CMDCASE)
+	case TSG_CMDNUM(TSG_BATCH):
+	case TSG_CMDNUM(TSG_WAIT_UNTIL):
+		break;
+	}
+}
+
+// return the tsg_ioctls index of cmd, or -1
 static int
-tsg_ioctl(struct cdev *dev, u_long cmd, caddr_t arg, int fflag, struct thread *td)
+tsg_find_ioctl(u_long cmd)
 {
-	struct tsg_softc *sc = dev->si_drv1;
+	int i = TSG_CMDNUM(cmd);
 
-	typedef int (*handler)(struct tsg_softc *, caddr_t);
-
-	static struct dispatcher {
-		u_long	cmd;
-		handler	fcn;
-	} tab[] = {
-		{ TSG_GET_BOARD_MODEL,		tsg_get_board_model },
-		{ TSG_GET_BOARD_FIRMWARE,	tsg_get_board_firmware },
-		{ TSG_GET_BOARD_TEST_STATUS,	tsg_get_board_test_status },
-		{ TSG_GET_BOARD_J1,		tsg_get_board_j1 },
-		{ TSG_SET_BOARD_J1,		tsg_set_board_j1 },
-		{ TSG_GET_BOARD_PIN6,		tsg_get_board_pin6 },
-		{ TSG_SET_BOARD_PIN6,		tsg_set_board_pin6 },
-		{ TSG_GET_PULSE_FREQ,		tsg_get_pulse_freq },
-		{ TSG_SET_PULSE_FREQ,		tsg_set_pulse_freq },
-		{ TSG_GET_GPS_ANTENNA_STATUS,	tsg_get_gps_antenna_status },
-		{ TSG_GET_CLOCK_LOCK,		tsg_get_clock_lock },
-		{ TSG_GET_CLOCK_TIMECODE,	tsg_get_clock_timecode },
-		{ TSG_SET_CLOCK_TIMECODE,	tsg_set_clock_timecode },
-		{ TSG_GET_CLOCK_REF,		tsg_get_clock_ref },
-		{ TSG_SET_CLOCK_REF,		tsg_set_clock_ref },
-		{ TSG_GET_CLOCK_TIME,		tsg_get_clock_time },
-		{ TSG_SET_CLOCK_TIME,		tsg_set_clock_time },
-		{ TSG_GET_GPS_POSITION,		tsg_get_gps_position },
-		{ TSG_GET_GPS_SIGNAL,		tsg_get_gps_signal },
-		{ TSG_GET_TIMECODE_AGC_DELAYS,	tsg_get_timecode_agc_delays },
-		{ TSG_GET_CLOCK_LEAP,		tsg_get_clock_leap },
-		{ TSG_SET_CLOCK_LEAP,		tsg_set_clock_leap },
-		{ TSG_GET_CLOCK_DAC,		tsg_get_clock_dac },
-		{ TSG_SAVE_CLOCK_DAC,		tsg_save_clock_dac },
-		{ TSG_GET_CLOCK_DST,		tsg_get_clock_dst },
-		{ TSG_SET_CLOCK_DST,		tsg_set_clock_dst },
-		{ TSG_GET_CLOCK_STOP,		tsg_get_clock_stop },
-		{ TSG_SET_CLOCK_STOP,		tsg_set_clock_stop },
-		{ TSG_GET_CLOCK_TZ_OFFSET,	tsg_get_clock_tz_offset },
-		{ TSG_SET_CLOCK_TZ_OFFSET,	tsg_set_clock_tz_offset },
-		{ TSG_GET_CLOCK_PHASE_COMP,	tsg_get_clock_phase_compensation },
-		{ TSG_SET_CLOCK_PHASE_COMP,	tsg_set_clock_phase_compensation },
-		{ TSG_GET_TIMECODE_QUALITY,	tsg_get_timecode_quality },
-		{ TSG_GET_USE_TIMECODE_QUALITY,	tsg_get_use_timecode_quality },
-		{ TSG_SET_USE_TIMECODE_QUALITY,	tsg_set_use_timecode_quality },
-		{ TSG_GET_SYNTH_FREQ,		tsg_get_synth_freq },
-		{ TSG_SET_SYNTH_FREQ,		tsg_set_synth_freq },
-		{ TSG_GET_SYNTH_EDGE,		tsg_get_synth_edge },
-		{ TSG_SET_SYNTH_EDGE,		tsg_set_synth_edge },
-		{ TSG_GET_SYNTH_ENABLE,		tsg_get_synth_enable },
-		{ TSG_SET_SYNTH_ENABLE,		tsg_set_synth_enable },
-		{ TSG_GET_COMPARE_TIME,		tsg_get_compare_time },
-		{ TSG_SET_COMPARE_TIME,		tsg_set_compare_time },
-		{ TSG_GET_INT_MASK,		tsg_get_int_mask },
-		{ TSG_SET_INT_MASK,		tsg_set_int_mask },
-		{ 0,				NULL },
-	};
-
-	for (struct dispatcher *p = tab; p->fcn; ++p)
-		if (p->cmd == cmd)
-			return (*p->fcn)(sc, arg);
-	return EOPNOTSUPP;
-}
-
-static int
-tsg_compare_ioctl(struct cdev *dev, u_long cmd, caddr_t arg, int fflag, struct thread *td)
+	if (tsg_ioctls[i].cmd != cmd || tsg_ioctls[i].fcn == NULL)
+		return -1;
+	return i;
+}
+
+// Handlers run with cfg_lock held, which also lets their register
+// traffic be charged to them.
+static int
+tsg_call(struct tsg_softc *sc, int i, caddr_t arg)
 {
-	struct tsg_softc *sc = dev->si_drv1;
-	int err;
+	struct tsg_cmdstats *cs = &sc->cmd_stats[i];
+	sbintime_t start;
+	uint64_t nsec;
+	int error;
 
-	if (cmd == TSG_GET_LATCHED_TIME) {
-		struct tsg_time *argp = (struct tsg_time *)arg;
-		lock(sc);
-		*argp = sc->pps_time_compare;
-		unlock(sc);
-		return 0;
-	} else if (cmd == TSG_GET_CLOCK_REF)
-		return tsg_get_clock_ref(sc, arg);
-	else if (cmd == TSG_GET_CLOCK_LOCK)
-		return tsg_get_clock_ref(sc, arg);
-
-	mtx_lock(&sc->pps_mtx_compare);
-	err = pps_ioctl(cmd, arg, &sc->pps_state_compare);
-	mtx_unlock(&sc->pps_mtx_compare);
-	return err;
+	sx_assert(&sc->cfg_lock, SA_XLOCKED);
+	sc->bus_acct = &cs->bus;
+	cs->bus.calls++;
+	start = sbinuptime();
+	error = (*tsg_ioctls[i].fcn)(sc, arg);
+	nsec = sbttons(sbinuptime() - start);
+	sc->bus_acct = &sc->bus_other;
+
+	if (error != 0)
+		cs->errors++;
+	cs->nsec_total += nsec;
+	if (nsec > cs->nsec_max)
+		cs->nsec_max = nsec;
+	return error;
 }
 
 static int
-tsg_ext_ioctl(struct cdev *dev, u_long cmd, caddr_t arg, int fflag, struct thread *td)
+tsg_dispatch(struct tsg_softc *sc, u_long cmd, caddr_t arg)
 {
-	struct tsg_softc *sc = dev->si_drv1;
-	int err;
+	int i, error;
 
-	if (cmd == TSG_GET_LATCHED_TIME) {
-		struct tsg_time *argp = (struct tsg_time *)arg;
+	if ((i = tsg_find_ioctl(cmd)) < 0)
+		return EOPNOTSUPP;
+
+	lock(sc);
+	error = tsg_call(sc, i, arg);
+	unlock(sc);
+	return error;
+}
+
+// Run each entry through the handlers, copying its argument in and out
+// the way ioctl(2) would. A snapshot batch holds cfg_lock throughout;
+// copyin and copyout may fault, which is fine with an sx lock.
+static int
+tsg_batch(struct tsg_softc *sc, struct tsg_batch *b)
+{
+	struct tsg_batch_entry *ents, *e;
+	uint64_t argbuf[64];
+	bool snapshot = (b->flags & TSG_BATCH_SNAPSHOT) != 0;
+	size_t len;
+	int i, n, error;
+
+	if (b->count > TSG_BATCH_MAX || (b->flags & ~TSG_BATCH_SNAPSHOT) != 0)
+		return EINVAL;
+	if (b->count == 0)
+		return 0;
+
+	ents = malloc(b->count * sizeof(*ents), M_DEVBUF, M_WAITOK);
+	error = copyin((void *)(uintptr_t)b->entries, ents, b->count * sizeof(*ents));
+	if (error != 0)
+		goto out;
+
+	if (snapshot)
 		lock(sc);
-		*argp = sc->pps_time_ext;
+	for (i = 0; i < b->count; ++i) {
+		e = &ents[i];
+		len = IOCPARM_LEN(e->cmd);
+		if ((n = tsg_find_ioctl(e->cmd)) < 0) {
+			e->error = EOPNOTSUPP;
+			continue;
+		}
+		if (len > sizeof(argbuf)) {
+			e->error = EINVAL;
+			continue;
+		}
+		if (e->cmd & IOC_IN) {
+			if ((e->error = copyin((void *)(uintptr_t)e->arg, argbuf, len)) != 0)
+				continue;
+		} else
+			memset(argbuf, 0, len);
+
+		if (!snapshot)
+			lock(sc);
+		e->error = tsg_call(sc, n, (caddr_t)argbuf);
+		if (!snapshot)
+			unlock(sc);
+
+		if (e->error == 0 && (e->cmd & IOC_OUT))
+			e->error = copyout(argbuf, (void *)(uintptr_t)e->arg, len);
+	}
+	if (snapshot)
 		unlock(sc);
-		return 0;
-	} else if (cmd == TSG_GET_CLOCK_REF)
-		return tsg_get_clock_ref(sc, arg);
-	else if (cmd == TSG_GET_CLOCK_LOCK)
-		return tsg_get_clock_ref(sc, arg);
-
-	mtx_lock(&sc->pps_mtx_ext);
-	err = pps_ioctl(cmd, arg, &sc->pps_state_ext);
-	mtx_unlock(&sc->pps_mtx_ext);
-	return err;
+
+	error = copyout(ents, (void *)(uintptr_t)b->entries, b->count * sizeof(*ents));
+out:
+	free(ents, M_DEVBUF);
+	return error;
 }
 
 static int
-tsg_pulse_ioctl(struct cdev *dev, u_long cmd, caddr_t arg, int fflag, struct thread *td)
+tsg_ioctl(struct cdev *dev, u_long cmd, caddr_t arg, int fflag, struct thread *td)
 {
 	struct tsg_softc *sc = dev->si_drv1;
+
+	// not in tsg_ioctls because they do their own locking
+	if (cmd == TSG_BATCH)
+		return tsg_batch(sc, (struct tsg_batch *)arg);
+	if (cmd == TSG_WAIT_UNTIL)
+		return tsg_wait_until(sc, (struct tsg_time *)arg);
+	return tsg_dispatch(sc, cmd, arg);
+}
+
+static struct sysctl_oid *
+tsg_add_busacct(struct sysctl_ctx_list *ctx, struct sysctl_oid *parent, const char *name, struct tsg_busacct *acct)
+{
+	struct sysctl_oid *node;
+
+	node = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(parent), OID_AUTO, name, CTLFLAG_RD, NULL, NULL);
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(node), OID_AUTO, "calls", CTLFLAG_RD,
+	    &acct->calls, 0, "times the handler ran");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(node), OID_AUTO, "reads", CTLFLAG_RD,
+	    &acct->reads, 0, "register read transactions");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(node), OID_AUTO, "writes", CTLFLAG_RD,
+	    &acct->writes, 0, "register write transactions");
+	return node;
+}
+
+static void
+tsg_add_cmdstats(struct sysctl_ctx_list *ctx, struct sysctl_oid *parent, const char *name, struct tsg_cmdstats *cs)
+{
+	struct sysctl_oid *node;
+
+	node = tsg_add_busacct(ctx, parent, name, &cs->bus);
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(node), OID_AUTO, "errors", CTLFLAG_RD,
+	    &cs->errors, 0, "calls that returned an error");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(node), OID_AUTO, "nsec_total", CTLFLAG_RD,
+	    &cs->nsec_total, 0, "total time in the handler");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(node), OID_AUTO, "nsec_max", CTLFLAG_RD,
+	    &cs->nsec_max, 0, "longest time in the handler");
+}
+
+// Print a histogram from tsg_intrstats (at offset arg2) as one line per
+// non-empty bucket, giving the bucket's upper bound and its count.
+static int
+tsg_sysctl_hist(SYSCTL_HANDLER_ARGS)
+{
+	struct tsg_softc *sc = arg1;
+	uint64_t hist[TSG_HIST_BUCKETS];
+	struct sbuf *sb;
+	int i, error;
+
+	mtx_lock_spin(&sc->latch_mtx);
+	memcpy(hist, (uint8_t *)&sc->intr_stats + arg2, sizeof(hist));
+	mtx_unlock_spin(&sc->latch_mtx);
+
+	sb = sbuf_new_for_sysctl(NULL, NULL, 512, req);
+	for (i = 0; i < TSG_HIST_BUCKETS - 1; ++i)
+		if (hist[i] != 0)
+			sbuf_printf(sb, "\n< %ju: %ju", (uintmax_t)1 << i, (uintmax_t)hist[i]);
+	if (hist[i] != 0)
+		sbuf_printf(sb, "\n>= %ju: %ju", (uintmax_t)1 << (i - 1), (uintmax_t)hist[i]);
+	error = sbuf_finish(sb);
+	sbuf_delete(sb);
+	return error;
+}
+
+static int
+tsg_sysctl_intr_reset(SYSCTL_HANDLER_ARGS)
+{
+	struct tsg_softc *sc = arg1;
+	int reset = 0;
+	int error;
+
+	error = sysctl_handle_int(oidp, &reset, 0, req);
+	if (error != 0 || req->newptr == NULL || reset == 0)
+		return error;
+
+	mtx_lock_spin(&sc->latch_mtx);
+	memset(&sc->intr_stats, 0, sizeof(sc->intr_stats));
+	mtx_unlock_spin(&sc->latch_mtx);
+	return 0;
+}
+
+// dev.tsg.N.bus.<handler>.{calls,reads,writes},
+// dev.tsg.N.ioctl.<command>.{calls,errors,nsec_total,nsec_max,reads,writes},
+// dev.tsg.N.lock.* and dev.tsg.N.intr.*
+static void
+tsg_add_sysctls(struct tsg_softc *sc)
+{
+	struct sysctl_ctx_list *ctx = device_get_sysctl_ctx(sc->device);
+	struct sysctl_oid *bus, *cmds, *locks, *intr, *events, *throttled;
+	struct tsg_intrstats *st = &sc->intr_stats;
+	int i;
+
+	sc->cmd_stats = malloc(nitems(tsg_ioctls) * sizeof(*sc->cmd_stats), M_DEVBUF, M_WAITOK | M_ZERO);
+	bus = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(device_get_sysctl_tree(sc->device)),
+	    OID_AUTO, "bus", CTLFLAG_RD, NULL, "register bus transactions by handler");
+	tsg_add_busacct(ctx, bus, "filter", &sc->bus_filter);
+	tsg_add_busacct(ctx, bus, "ithread", &sc->bus_ithrd);
+	tsg_add_busacct(ctx, bus, "preset", &sc->bus_preset);
+	tsg_add_busacct(ctx, bus, "watch", &sc->bus_watch);
+	tsg_add_busacct(ctx, bus, "wait", &sc->bus_cmpq);
+	tsg_add_busacct(ctx, bus, "other", &sc->bus_other);
+
+	cmds = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(device_get_sysctl_tree(sc->device)),
+	    OID_AUTO, "ioctl", CTLFLAG_RD, NULL, "main device ioctls by command");
+	for (i = 0; i < nitems(tsg_ioctls); ++i)
+		if (tsg_ioctls[i].fcn != NULL)
+			tsg_add_cmdstats(ctx, cmds, tsg_ioctls[i].name, &sc->cmd_stats[i]);
+
+	locks = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(device_get_sysctl_tree(sc->device)),
+	    OID_AUTO, "lock", CTLFLAG_RD, NULL, "lock contention");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(locks), OID_AUTO, "cfg_contended", CTLFLAG_RD,
+	    &sc->cfg_contended, 0, "ioctls that waited for another ioctl");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(locks), OID_AUTO, "latch_contended", CTLFLAG_RD,
+	    &sc->latch_contended, 0, "interrupts that found the latch lock held");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(locks), OID_AUTO, "latch_waits", CTLFLAG_RD,
+	    &sc->latch_waits, 0, "ioctl latches that waited for the interrupt thread");
+
+	intr = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(device_get_sysctl_tree(sc->device)),
+	    OID_AUTO, "intr", CTLFLAG_RD, NULL, "interrupt statistics");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(intr), OID_AUTO, "interrupts", CTLFLAG_RD,
+	    &st->interrupts, 0, "interrupts seen by the filter");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(intr), OID_AUTO, "stray", CTLFLAG_RD,
+	    &st->stray, 0, "interrupts with none of our enabled events");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(intr), OID_AUTO, "deferred", CTLFLAG_RD,
+	    &st->deferred, 0, "interrupts that found the previous latch uncollected");
+	events = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(intr), OID_AUTO, "events",
+	    CTLFLAG_RD, NULL, "events captured by source");
+	for (i = 0; i < NSOURCES; ++i)
+		SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(events), OID_AUTO, sc->sources[i].name,
+		    CTLFLAG_RD, &st->events[i], 0, "events captured");
+	throttled = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(intr), OID_AUTO, "throttled",
+	    CTLFLAG_RD, NULL, "sources masked for exceeding their rate limit");
+	for (i = 0; i < NSOURCES; ++i)
+		SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(throttled), OID_AUTO, sc->sources[i].name,
+		    CTLFLAG_RD, &st->throttled[i], 0, "times masked");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(intr), OID_AUTO, "filter_cycles",
+	    CTLTYPE_STRING | CTLFLAG_RD | CTLFLAG_MPSAFE, sc,
+	    offsetof(struct tsg_intrstats, filter_cycles), tsg_sysctl_hist, "A",
+	    "interrupt filter run time histogram, in CPU cycles");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(intr), OID_AUTO, "ithread_cycles",
+	    CTLTYPE_STRING | CTLFLAG_RD | CTLFLAG_MPSAFE, sc,
+	    offsetof(struct tsg_intrstats, ithrd_cycles), tsg_sysctl_hist, "A",
+	    "interrupt thread run time histogram, in CPU cycles");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(intr), OID_AUTO, "reset",
+	    CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_MPSAFE, sc, 0, tsg_sysctl_intr_reset, "I",
+	    "set to 1 to zero the interrupt statistics");
+}
+
+// Return the next event this reader hasn't seen, waiting for up to
+// timeout_ms for one to arrive.
+static int
+wait_event(struct tsg_source *src, struct ring_reader *rd, struct tsg_event_wait *w)
+{
+	struct timeval tv;
+	int timo = 0;
 	int err;
 
-	if (cmd == TSG_GET_LATCHED_TIME) {
-		struct tsg_time *argp = (struct tsg_time *)arg;
-		lock(sc);
-		*argp = sc->pps_time_pulse;
-		unlock(sc);
-		return 0;
-	} else if (cmd == TSG_GET_CLOCK_REF)
-		return tsg_get_clock_ref(sc, arg);
-	else if (cmd == TSG_GET_CLOCK_LOCK)
-		return tsg_get_clock_ref(sc, arg);
-
-	mtx_lock(&sc->pps_mtx_pulse);
-	err = pps_ioctl(cmd, arg, &sc->pps_state_pulse);
-	mtx_unlock(&sc->pps_mtx_pulse);
-	return err;
+	if (w->timeout_ms != TSG_WAIT_FOREVER) {
+		tv.tv_sec = w->timeout_ms / 1000;
+		tv.tv_usec = (w->timeout_ms % 1000) * 1000;
+		timo = tvtohz(&tv);
+	}
+
+	mtx_lock(&src->mtx);
+	if (w->timeout_ms == 0 && ring_avail(&src->ring, rd) == 0)
+		err = EWOULDBLOCK;
+	else
+		err = ring_wait(&src->ring, rd, timo);
+	if (err == 0)
+		ring_get(&src->ring, rd, &w->event, 1);
+	mtx_unlock(&src->mtx);
+
+	return err == EWOULDBLOCK ? ETIMEDOUT : err;
 }
 
 static int
-tsg_synth_ioctl(struct cdev *dev, u_long cmd, caddr_t arg, int fflag, struct thread *td)
+tsg_source_ioctl(struct cdev *dev, u_long cmd, caddr_t arg, int fflag, struct thread *td)
 {
 	struct tsg_softc *sc = dev->si_drv1;
+	struct tsg_source *src = dev->si_drv2;
 	int err;
 
 	if (cmd == TSG_GET_LATCHED_TIME) {
 		struct tsg_time *argp = (struct tsg_time *)arg;
-		lock(sc);
-		*argp = sc->pps_time_synth;
-		unlock(sc);
+		mtx_lock(&src->mtx);
+		*argp = src->time;
+		mtx_unlock(&src->mtx);
+		return 0;
+	} else if (cmd == TSG_GET_LATCHED_TIME_CYCLES) {
+		struct tsg_time_cycles *argp = (struct tsg_time_cycles *)arg;
+		mtx_lock(&src->mtx);
+		argp->time = src->time;
+		argp->cycles = src->cycles;
+		mtx_unlock(&src->mtx);
+		return 0;
+	} else if (cmd == TSG_GET_EVENT_LIMITS) {
+		struct tsg_event_limits *argp = (struct tsg_event_limits *)arg;
+		mtx_lock_spin(&sc->latch_mtx);
+		argp->decimate = src->decimate;
+		argp->max_rate = src->max_rate;
+		argp->throttled = sc->intr_stats.throttled[src - sc->sources];
+		mtx_unlock_spin(&sc->latch_mtx);
+		return 0;
+	} else if (cmd == TSG_SET_EVENT_LIMITS) {
+		struct tsg_event_limits *argp = (struct tsg_event_limits *)arg;
+		if (argp->decimate == 0 || argp->max_rate == 0 || argp->max_rate > TSG_RATE_MAX)
+			return EINVAL;
+		mtx_lock_spin(&sc->latch_mtx);
+		src->decimate = argp->decimate;
+		src->edges = 0;
+		src->max_rate = argp->max_rate;
+		mtx_unlock_spin(&sc->latch_mtx);
+		return 0;
+	} else if (cmd == TSG_GET_EVENT_STATS) {
+		struct tsg_event_stats *argp = (struct tsg_event_stats *)arg;
+		struct ring_reader *rd;
+		if ((err = devfs_get_cdevpriv((void **)&rd)) != 0)
+			return err;
+		mtx_lock(&src->mtx);
+		argp->unread = ring_avail(&src->ring, rd);
+		argp->events = src->ring.head;
+		argp->lost = rd->lost;
+		mtx_unlock(&src->mtx);
 		return 0;
-	} else if (cmd == TSG_GET_CLOCK_REF)
-		return tsg_get_clock_ref(sc, arg);
-	else if (cmd == TSG_GET_CLOCK_LOCK)
-		return tsg_get_clock_ref(sc, arg);
-
-	mtx_lock(&sc->pps_mtx_synth);
-	err = pps_ioctl(cmd, arg, &sc->pps_state_synth);
-	mtx_unlock(&sc->pps_mtx_synth);
+	} else if (cmd == TSG_WAIT_EVENT) {
+		struct ring_reader *rd;
+		if ((err = devfs_get_cdevpriv((void **)&rd)) != 0)
+			return err;
+		return wait_event(src, rd, (struct tsg_event_wait *)arg);
+	} else if (cmd == TSG_GET_CLOCK_REF || cmd == TSG_GET_CLOCK_LOCK)
+		return tsg_dispatch(sc, cmd, arg);
+
+	mtx_lock(&src->mtx);
+	err = pps_ioctl(cmd, arg, &src->pps_state);
+	mtx_unlock(&src->mtx);
 	return err;
 }
 
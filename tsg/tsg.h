@@ -9,6 +9,7 @@
 #ifndef	_KERNEL
 #include <sys/ioctl.h>
 #include <sys/types.h>
+#include <sys/time.h>
 #endif
 
 /* these model numbers correspond to PCI subdevice ids; don't change */
@@ -101,6 +102,75 @@ struct tsg_time {
 #define	TSG_GET_CLOCK_TIME	_IOR('T', 60, struct tsg_time)
 #define	TSG_SET_CLOCK_TIME	_IOW('T', 61, struct tsg_time)
 
+/*
+ * TSG_SET_CLOCK_TIME only starts a preset; the board takes 20-200 msec to
+ * load it. The main device polls readable once a preset that this open
+ * file hasn't collected with TSG_GET_CLOCK_PRESET has finished.
+ */
+#define	TSG_PRESET_IDLE		0	// no preset since the driver loaded
+#define	TSG_PRESET_BUSY		1	// waiting for the board to load the time
+#define	TSG_PRESET_DONE		2
+#define	TSG_PRESET_TIMEOUT	3	// board didn't load the time within a second
+
+struct tsg_preset_status {
+	uint32_t generation;	// number of presets started
+	uint8_t  state;		// of the latest preset (TSG_PRESET_*)
+	uint32_t msec;		// how long it took or has taken so far
+};
+
+#define	TSG_GET_CLOCK_PRESET	_IOR('T', 62, struct tsg_preset_status)
+
+/*
+ * System time in the records below. A struct timespec is smaller in 32 bit
+ * programs, so these use fixed-width fields, and the records pad 64 bit
+ * fields to 8 byte offsets themselves.
+ */
+struct tsg_timespec {
+	int64_t		sec;
+	uint32_t	nsec;
+	uint32_t	pad;
+};
+
+/*
+ * Measure the offset between board and system time without interrupts.
+ * For each sample the driver reads the system clock (pre), latches the
+ * board time, reads the system clock again once the latch has reached the
+ * board (post), then reads the latched time. The latch happened somewhere
+ * between pre and post, so the sample with the smallest post - pre gives
+ * the tightest bound.
+ */
+#define	TSG_OFFSET_MAX_SAMPLES	25
+
+struct tsg_offset_sample {
+	struct tsg_timespec	pre;
+	struct tsg_time		board;
+	uint32_t		pad;
+	struct tsg_timespec	post;
+	uint64_t		cycles;		// cycle counter just before the latch
+};
+
+struct tsg_clock_offset {
+	uint32_t		 samples;	// how many to take, up to TSG_OFFSET_MAX_SAMPLES
+	uint32_t		 pad;
+	struct tsg_offset_sample sample[TSG_OFFSET_MAX_SAMPLES];
+};
+
+#define	TSG_GET_CLOCK_OFFSET	_IOWR('T', 63, struct tsg_clock_offset)
+
+/*
+ * A latched board time with the CPU cycle counter read just before the
+ * latch write, so userland can relate board time to the cycle counter
+ * directly. The counter is the kernel's get_cyclecount(), which on amd64
+ * is the TSC that userland can read with rdtsc.
+ */
+struct tsg_time_cycles {
+	struct tsg_time	time;
+	uint32_t	pad;
+	uint64_t	cycles;
+};
+
+#define	TSG_GET_CLOCK_TIME_CYCLES	_IOR('T', 64, struct tsg_time_cycles)
+
 struct tsg_position {
 	uint16_t lat_deg;
 	uint16_t lat_min;
@@ -120,7 +190,7 @@ struct tsg_position {
 };
 
 #define TSG_GET_GPS_POSITION	_IOR('T', 70, struct tsg_position)
-#define	TSG_SET_GPS_POSITION	_IOW('T', 71, struct tsg_position)
+#define	TSG_SET_GPS_POSITION	_IOW('T', 71, struct tsg_position)	// not supported
 
 #define	TSG_MAX_SATELLITES	6
 struct tsg_satellite {
@@ -218,6 +288,50 @@ struct tsg_compare_time {
 #define	TSG_GET_COMPARE_TIME		_IOR('T', 210, struct tsg_compare_time)
 #define	TSG_SET_COMPARE_TIME		_IOW('T', 211, struct tsg_compare_time)
 
+/*
+ * Sleep until the board clock reaches a time, to the microsecond.
+ * The driver keeps the compare register armed for the earliest sleeper,
+ * so while anyone is waiting TSG_SET_COMPARE_TIME fails with EBUSY, and
+ * the compare interrupt is enabled whatever TSG_SET_INT_MASK says.
+ * Times already past return at once. EAGAIN means too many sleepers.
+ */
+#define	TSG_WAIT_UNTIL			_IOW('T', 212, struct tsg_time)
+
+/*
+ * A schedule of compare strobes run by the driver, which arms the next one
+ * from the interrupt thread as each fires. It is either a list of times or,
+ * when count is 0, a periodic rule. Setting a new schedule replaces the old
+ * one; a periodic rule with period 0 just stops it. The schedule shares the
+ * compare register with TSG_WAIT_UNTIL, and holds it the same way. A
+ * periodic rule skips the strobes that are already past when it starts, or
+ * after the board time jumps, and counts them as missed.
+ */
+#define	TSG_SCHEDULE_MAX	1024	// times in a list
+#define	TSG_SCHEDULE_MIN_PERIOD	100	// usec
+
+struct tsg_schedule {
+	uint64_t	times;		// list: ascending board times (struct tsg_time *)
+	uint32_t	count;		// times in the list, or 0 for periodic
+	struct tsg_time	start;		// periodic: the first strobe
+	uint32_t	period;		// periodic: usec between strobes
+	uint32_t	repeat;		// periodic: number of strobes, 0 for no end
+};
+
+#define	TSG_SCHEDULE_IDLE	0	// no schedule loaded
+#define	TSG_SCHEDULE_RUNNING	1
+#define	TSG_SCHEDULE_DONE	2
+
+struct tsg_schedule_status {
+	uint8_t		state;		// TSG_SCHEDULE_*
+	uint32_t	fired;		// strobes the register was armed for in time
+	uint32_t	missed;		// strobes already past when their turn came
+	uint32_t	left;		// strobes to come; 0 and running means no end
+	struct tsg_time	next;		// the next strobe, while running
+};
+
+#define	TSG_SET_SCHEDULE		_IOW('T', 213, struct tsg_schedule)
+#define	TSG_GET_SCHEDULE		_IOR('T', 214, struct tsg_schedule_status)
+
 #define	TSG_GET_BOARD_PIN6		_IOR('T', 220, uint8_t)
 #define	TSG_SET_BOARD_PIN6		_IOW('T', 221, uint8_t)
 
@@ -233,4 +347,248 @@ struct tsg_compare_time {
 
 #define	TSG_GET_LATCHED_TIME		_IOR('T', 240, struct tsg_time)
 
+/* records read(2) from the .compare, .ext, .pulse and .synth devices */
+struct tsg_event {
+	uint32_t	sequence;	// PPS API assert sequence number
+	uint32_t	pad;
+	struct tsg_timespec timestamp;	// system time of the event
+	struct tsg_time	time;		// board time latched at the event
+
+	/* board status when the event was handled */
+	uint8_t		lock;		// TSG_CLOCK_* lock bits
+	uint8_t		ref;		// TSG_CLOCK_REF_*
+	struct tsg_timecode_quality quality;	// zero on old boards
+
+	/*
+	 * Pulse and synth edges fall on a grid of board time set by their
+	 * frequency (and for the synth, the on time edge), so the driver can
+	 * tell when the edge itself happened. time is later by the interrupt
+	 * latency. Not set for the other sources, or for synth frequencies
+	 * that don't divide a second into whole nanoseconds.
+	 */
+	uint8_t		flags;		// TSG_EVENT_*
+	struct tsg_time	edge;		// board time of the edge
+	uint32_t	latency;	// nsec from edge to time
+	uint32_t	pad2;
+
+	uint64_t	cycles;		// cycle counter when time was latched
+};
+
+#define	TSG_EVENT_EDGE		0x01	// edge and latency are valid
+
+struct tsg_event_stats {
+	uint64_t	events;		// events captured since the driver attached
+	uint64_t	lost;		// events overwritten before this reader read them
+	uint32_t	unread;		// events waiting to be read
+	uint32_t	pad;
+};
+
+#define	TSG_GET_EVENT_STATS		_IOR('T', 241, struct tsg_event_stats)
+
+/* wait for the next event; shares the read position with read(2) */
+#define	TSG_WAIT_FOREVER	0xffffffff
+
+struct tsg_event_wait {
+	uint32_t	timeout_ms;	// 0 to poll, or TSG_WAIT_FOREVER
+	uint32_t	pad;
+	struct tsg_event event;
+};
+
+#define	TSG_WAIT_EVENT			_IOWR('T', 242, struct tsg_event_wait)
+
+/* TSG_GET_LATCHED_TIME with the cycle counter (see struct tsg_time_cycles) */
+#define	TSG_GET_LATCHED_TIME_CYCLES	_IOR('T', 247, struct tsg_time_cycles)
+
+/*
+ * Each event device limits its interrupt rate. An edge beyond max_rate in
+ * one second masks the source in the interrupt mask (re-enable it with
+ * TSG_SET_INT_MASK), and only every decimate'th edge that gets through is
+ * timestamped and delivered.
+ */
+#define	TSG_RATE_DEFAULT		20000
+#define	TSG_RATE_MAX			100000
+
+struct tsg_event_limits {
+	uint32_t	decimate;	// deliver every Nth edge; 1 for all of them
+	uint32_t	max_rate;	// edges per second, 1 to TSG_RATE_MAX
+	uint64_t	throttled;	// times the source was masked; ignored when set
+};
+
+#define	TSG_GET_EVENT_LIMITS		_IOR('T', 248, struct tsg_event_limits)
+#define	TSG_SET_EVENT_LIMITS		_IOW('T', 249, struct tsg_event_limits)
+
+/*
+ * TSG_BATCH runs up to TSG_BATCH_MAX main device ioctls in one call.
+ * Each entry's arg holds the address of that ioctl's usual argument, and
+ * its error is set to what the ioctl would have returned. The batch itself
+ * only fails if the entries can't be read or written back. With
+ * TSG_BATCH_SNAPSHOT no other ioctl can run between the entries, so
+ * getters see one state.
+ *
+ * Addresses in ioctl arguments here are uint64_t, so that 32 bit programs
+ * on a 64 bit kernel pass the same structs with the same ioctl numbers.
+ * The same goes for system times (struct tsg_timespec).
+ */
+struct tsg_batch_entry {
+	uint32_t	cmd;
+	int32_t		error;
+	uint64_t	arg;		// void *
+};
+
+#define	TSG_BATCH_MAX		64
+#define	TSG_BATCH_SNAPSHOT	0x01
+
+struct tsg_batch {
+	uint32_t		count;
+	uint32_t		flags;		// TSG_BATCH_*
+	uint64_t		entries;	// struct tsg_batch_entry *
+};
+
+#define	TSG_BATCH			_IOW('T', 243, struct tsg_batch)
+
+/*
+ * Everything a monitor usually wants, read as one snapshot. Fields that
+ * don't apply to the board (eg antenna without GPS) are zero.
+ */
+struct tsg_status {
+	uint16_t			model;
+	struct tsg_board_firmware	firmware;
+	uint8_t				test_status;	// TSG_TEST_*
+	uint8_t				lock;		// TSG_CLOCK_*_LOCK, TSG_CLOCK_INPUT_VALID
+	uint8_t				ref;		// TSG_CLOCK_REF_*
+	uint8_t				timecode;	// TSG_CLOCK_TIMECODE_*
+	uint16_t			dac;
+	uint8_t				leap;
+	uint8_t				dst;
+	uint8_t				stop;
+	uint8_t				use_quality;
+	struct tsg_timecode_quality	quality;
+	uint8_t				antenna;	// TSG_GPS_ANTENNA_*
+	uint8_t				intmask;	// TSG_INT_ENABLE_*
+	struct tsg_time			time;
+};
+
+#define	TSG_GET_STATUS			_IOR('T', 244, struct tsg_status)
+
+/*
+ * The driver samples the lock, antenna, timecode quality and test status
+ * registers every watch interval, and whenever one changes queues a
+ * struct tsg_status_change, which can be read(2) from the main device.
+ * Each open file sees the changes made after it was opened; sequence
+ * numbers are consecutive, so a gap means the reader fell behind.
+ * The main device polls readable while there are changes to read.
+ */
+#define	TSG_CHANGE_LOCK		0x01
+#define	TSG_CHANGE_ANTENNA	0x02
+#define	TSG_CHANGE_QUALITY	0x04
+#define	TSG_CHANGE_TEST		0x08
+
+struct tsg_status_change {
+	uint32_t			sequence;
+	uint32_t			pad;
+	struct tsg_timespec		timestamp;	// system time of the sample
+	uint8_t				changed;	// TSG_CHANGE_*
+	uint8_t				lock;		// as in struct tsg_status
+	uint8_t				antenna;
+	struct tsg_timecode_quality	quality;
+	uint8_t				test_status;
+};
+
+#define	TSG_WATCH_DEFAULT_MS	100
+#define	TSG_WATCH_MAX_MS	60000
+
+// msec between samples, 0 to stop watching
+#define	TSG_GET_WATCH_INTERVAL		_IOR('T', 250, uint32_t)
+#define	TSG_SET_WATCH_INTERVAL		_IOW('T', 251, uint32_t)
+
+/*
+ * Telemetry. Each watch sample also reads the DAC and, on GPS boards, the
+ * satellite table, and is cached: while sampling is on, TSG_GET_CLOCK_LOCK,
+ * TSG_GET_CLOCK_DAC, TSG_GET_TIMECODE_QUALITY, TSG_GET_GPS_ANTENNA_STATUS
+ * and TSG_GET_GPS_SIGNAL are answered from the cache without touching the
+ * board. TSG_GET_TELEMETRY returns the cached sample and its age.
+ * A sample is kept in the history once a second, and TSG_GET_TELEMETRY_HISTORY
+ * copies out the latest count of them, oldest first.
+ */
+#define	TSG_TELEMETRY_HISTORY	8192	// samples, a little over 2 hours
+
+#define	TSG_TELEMETRY_SIGNAL	0x01	// signal holds a satellite table
+
+struct tsg_telemetry {
+	struct tsg_timespec		timestamp;	// system time of the sample
+	uint16_t			dac;
+	uint8_t				lock;
+	uint8_t				antenna;
+	struct tsg_timecode_quality	quality;
+	uint8_t				test_status;
+	uint8_t				flags;		// TSG_TELEMETRY_*
+	struct tsg_signal		signal;
+	uint8_t				pad[6];
+};
+
+struct tsg_telemetry_current {
+	struct tsg_telemetry	sample;
+	uint32_t		age_ms;
+	uint32_t		pad;
+};
+
+struct tsg_telemetry_history {
+	uint32_t		count;		// in: room in samples; out: number copied
+	uint32_t		pad;
+	uint64_t		samples;	// struct tsg_telemetry *
+};
+
+#define	TSG_GET_TELEMETRY		_IOR('T', 252, struct tsg_telemetry_current)
+#define	TSG_GET_TELEMETRY_HISTORY	_IOWR('T', 253, struct tsg_telemetry_history)
+
+/*
+ * Interrupt latency benchmark. Pulse generator edges fall exactly on
+ * decade boundaries of board time, so the board time latched by the
+ * interrupt filter less the preceding edge is the interrupt latency as the
+ * board saw it. TSG_START_BENCH sets the pulse frequency and enables pulse
+ * interrupts for the given number of seconds, then puts both back; pulse
+ * events still reach the .pulse device meanwhile.
+ * Latencies are counted in TSG_BENCH_BIN_NS wide bins, and percentiles are
+ * the upper edge of their bin. Latencies of a whole pulse period or more
+ * wrap around, so use a low frequency to look for long ones.
+ */
+#define	TSG_BENCH_IDLE		0	// no benchmark since the driver loaded
+#define	TSG_BENCH_RUNNING	1
+#define	TSG_BENCH_DONE		2
+
+#define	TSG_BENCH_BIN_NS	100
+#define	TSG_BENCH_BINS		4096	// the last bin also holds everything longer
+#define	TSG_BENCH_MAX_SECONDS	86400
+
+struct tsg_bench_config {
+	uint8_t		freq;		// TSG_PULSE_FREQ_1HZ to TSG_PULSE_FREQ_10KHZ
+	uint32_t	seconds;
+};
+
+struct tsg_bench_result {
+	uint8_t		state;		// TSG_BENCH_*
+	uint8_t		freq;
+	uint32_t	seconds;
+	uint64_t	samples;
+	uint32_t	min_ns;
+	uint32_t	p50_ns;
+	uint32_t	p99_ns;
+	uint32_t	max_ns;
+};
+
+#define	TSG_START_BENCH			_IOW('T', 245, struct tsg_bench_config)
+#define	TSG_GET_BENCH			_IOR('T', 246, struct tsg_bench_result)
+
+/*
+ * Each event device can be mmap(2)ed read-only to get a page holding the
+ * latest event. The driver makes seq odd while it is updating the event,
+ * so readers must read seq, copy the event, and start again if seq was odd
+ * or has since changed. tsglib's tsg_read_event_page() does this.
+ */
+struct tsg_event_page {
+	volatile uint32_t	seq;
+	uint32_t		pad;
+	struct tsg_event	event;
+};
+
 #endif
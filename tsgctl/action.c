@@ -8,6 +8,9 @@
 #include "board.h"
 #include "event.h"
 #include "compare.h"
+#include "status.h"
+#include "bench.h"
+#include "survey.h"
 #include "action.h"
 
 static int
@@ -22,6 +25,9 @@ get(int fd)
 		{ "board", "PCI board", get_board },
 		{ "event", "event timestamper", get_event },
 		{ "compare", "time comparator", get_compare },
+		{ "status", "everything, in one snapshot", get_status },
+		{ "watch", "status change sampling interval", get_watch },
+		{ "telemetry", "sampled status and its history", get_telemetry },
 		{ NULL, NULL, NULL },
 	};
 
@@ -39,6 +45,7 @@ set(int fd)
 		{ "board", "PCI board", set_board },
 		{ "event", "event timestamper", set_event },
 		{ "compare", "time comparator", set_compare },
+		{ "watch", "status change sampling interval", set_watch },
 		{ NULL, NULL, NULL },
 	};
 
@@ -78,6 +85,17 @@ reset(int fd)
 	return walk(components, fd);
 }
 
+static int
+bench(int fd)
+{
+	static struct node components[] = {
+		{ "latency", "interrupt latency, as measured by the board", bench_latency },
+		{ NULL, NULL, NULL },
+	};
+
+	return walk(components, fd);
+}
+
 static int
 save(int fd)
 {
@@ -100,6 +118,10 @@ action(int fd)
 		{ "reset", "reset factory parameters", reset },
 		{ "restore", "restore eeprom parameters", restore },
 		{ "save", "save eeprom parameters", save } ,
+		{ "bench", "run a driver benchmark", bench },
+		{ "wait", "sleep on the time comparator", wait_compare },
+		{ "watch", "print status changes as they happen", watch_status },
+		{ "survey", "average the GPS position", survey_gps },
 		{ NULL, NULL, NULL },
 	};
 
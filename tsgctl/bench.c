@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "gettok.h"
+#include "map.h"
+#include "tsglib.h"
+#include "bench.h"
+
+// the pulse frequencies old and new boards can both interrupt at
+static struct map freq_map[] = {
+	{ TSG_PULSE_FREQ_1HZ, "1Hz" },
+	{ TSG_PULSE_FREQ_10HZ, "10Hz" },
+	{ TSG_PULSE_FREQ_100HZ, "100Hz" },
+	{ TSG_PULSE_FREQ_1KHZ, "1kHz" },
+	{ TSG_PULSE_FREQ_10KHZ, "10kHz" },
+	{ 0, NULL }
+};
+
+/*
+ * Run the driver's interrupt latency benchmark for the given number of
+ * seconds at the given pulse frequency, then print the latencies the
+ * board measured.
+ */
+int
+bench_latency(int fd)
+{
+	char *s = gettok();
+	char *end;
+	struct tsg_bench_config cfg;
+	struct tsg_bench_result r;
+
+	if (s == NULL || (cfg.freq = mapbydesc(freq_map, s, 0xff)) == 0xff) {
+		printmap(stdout, freq_map, 0);
+		return -2;
+	}
+	if ((s = gettok()) == NULL ||
+	    (cfg.seconds = strtoul(s, &end, 10)) == 0 || *end != '\0' ||
+	    cfg.seconds > TSG_BENCH_MAX_SECONDS) {
+		printf("expected a number of seconds, up to %d\n", TSG_BENCH_MAX_SECONDS);
+		return -2;
+	}
+
+	if (tsg_start_bench(fd, &cfg) != 0)
+		return -1;
+	sleep(cfg.seconds);
+	for (;;) {
+		if (tsg_get_bench(fd, &r) != 0)
+			return -1;
+		if (r.state != TSG_BENCH_RUNNING)
+			break;
+		usleep(100000);
+	}
+
+	printf("samples: %ju\n", (uintmax_t)r.samples);
+	if (r.samples == 0)
+		return 0;
+	printf("min: %u nsec\n", r.min_ns);
+	printf("p50: %u nsec\n", r.p50_ns);
+	printf("p99: %u nsec\n", r.p99_ns);
+	printf("max: %u nsec\n", r.max_ns);
+	return 0;
+}
@@ -0,0 +1 @@
+int bench_latency(int fd);
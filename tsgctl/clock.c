@@ -1,4 +1,7 @@
+#include <errno.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <sys/time.h>
@@ -147,7 +150,96 @@ set_time(int fd)
 		return -2;
 	}
 
-	return tsg_set_clock_time(fd, &t);
+	if (tsg_set_clock_time(fd, &t) != 0)
+		return -1;
+
+	/* the driver returns straight away; wait for the board to load the time */
+	struct tsg_preset_status st;
+	if (tsg_wait_clock_preset(fd, 2000, &st) != 0)
+		return -1;
+	if (st.state != TSG_PRESET_DONE) {
+		errno = ETIMEDOUT;
+		return -1;
+	}
+	return 0;
+}
+
+/* board time as nsec since the epoch */
+static int64_t
+board_nsec(struct tsg_time *t)
+{
+	struct tm tm = {
+		.tm_year = t->year - 1900,
+		.tm_mday = t->day,	/* timegm normalises day of year */
+		.tm_hour = t->hour,
+		.tm_min = t->min,
+		.tm_sec = t->sec,
+	};
+
+	return (int64_t)timegm(&tm) * 1000000000 + t->nsec;
+}
+
+static int64_t
+ts_nsec(struct tsg_timespec *ts)
+{
+	return ts->sec * 1000000000 + ts->nsec;
+}
+
+/*
+ * Print board time less system time, from the sample whose system clock
+ * reads were closest together. The board was latched somewhere between
+ * them, so half their distance bounds the error.
+ */
+static int
+get_offset(int fd)
+{
+	char *s = gettok();
+	struct tsg_clock_offset o;
+	int64_t pre, post, delay, best = -1, offset = 0;
+	uint32_t i;
+
+	o.samples = 10;
+	if (s != NULL && ((o.samples = strtoul(s, NULL, 10)) == 0 || o.samples > TSG_OFFSET_MAX_SAMPLES)) {
+		printf("expected a number of samples, up to %d\n", TSG_OFFSET_MAX_SAMPLES);
+		return -2;
+	}
+	if (tsg_get_clock_offset(fd, &o) != 0)
+		return -1;
+
+	for (i = 0; i < o.samples; ++i) {
+		pre = ts_nsec(&o.sample[i].pre);
+		post = ts_nsec(&o.sample[i].post);
+		delay = post - pre;
+		if (best < 0 || delay < best) {
+			best = delay;
+			offset = board_nsec(&o.sample[i].board) - (pre + delay / 2);
+		}
+	}
+	printf("offset: %+jd nsec\n", (intmax_t)offset);
+	printf("delay: %jd nsec\n", (intmax_t)best);
+	return 0;
+}
+
+static struct map preset_map[] = {
+	{ TSG_PRESET_IDLE,	"none" },
+	{ TSG_PRESET_BUSY,	"in progress" },
+	{ TSG_PRESET_DONE,	"done" },
+	{ TSG_PRESET_TIMEOUT,	"timed out" },
+	{ 0,			NULL }
+};
+
+static int
+get_preset(int fd)
+{
+	struct tsg_preset_status st;
+
+	if (tsg_get_clock_preset(fd, &st) != 0)
+		return -1;
+	printf("presets: %u\n", st.generation);
+	printf("last preset: %s\n", mapbyval(preset_map, st.state, "unknown"));
+	if (st.state != TSG_PRESET_IDLE)
+		printf("took: %u msec\n", st.msec);
+	return 0;
 }
 
 static int
@@ -436,6 +528,8 @@ get_clock(int fd)
 {
 	static struct node params[] = {
 		{ "time", "board clock time", get_time },
+		{ "preset", "status of the last time preset", get_preset },
+		{ "offset", "board time less system time", get_offset },
 		{ "lock", "lock status", get_lock },
 		{ "dac", "DAC value", get_dac },
 		{ "leap", "leap second scheduled", get_leap },
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include "gettok.h"
 #include "node.h"
 #include "tsglib.h"
@@ -61,11 +62,161 @@ set_time(int fd)
 	return tsg_set_compare_time(fd, &t);
 }
 
+static char *time_msg = "time looks like YYYY-DDD-HH:MM:SS.uuuuuu";
+
+// parse a board time to the microsecond; returns -1 if it doesn't look like one
+static int
+parse_time(char *s, struct tsg_time *t)
+{
+	unsigned year, day, hour, min, sec, usec;
+
+	if (s == NULL || sscanf(s, "%u-%u-%u:%u:%u.%u",
+	    &year, &day, &hour, &min, &sec, &usec) != 6)
+		return -1;
+	t->year = year;
+	t->day = day;
+	t->hour = hour;
+	t->min = min;
+	t->sec = sec;
+	t->nsec = usec * 1000;
+	return 0;
+}
+
+static void
+print_time(struct tsg_time *t)
+{
+	printf(
+		"%04u-%03u-%02u:%02u:%02u.%09u\n",
+		t->year,
+		t->day,
+		t->hour,
+		t->min,
+		t->sec,
+		t->nsec
+	);
+}
+
+// sleep until a board time, then print the time it woke up
+static int
+until(int fd)
+{
+	struct tsg_time t;
+
+	if (parse_time(gettok(), &t) != 0) {
+		puts(time_msg);
+		return -2;
+	}
+	if (tsg_wait_until(fd, &t) != 0 || tsg_get_clock_time(fd, &t) != 0)
+		return -1;
+	print_time(&t);
+	return 0;
+}
+
+static int
+get_schedule(int fd)
+{
+	struct tsg_schedule_status st;
+	static char *states[] = { "idle", "running", "done" };
+
+	if (tsg_get_schedule(fd, &st) != 0)
+		return -1;
+	printf("state: %s\n", st.state < 3 ? states[st.state] : "unknown");
+	printf("fired: %u\n", st.fired);
+	printf("missed: %u\n", st.missed);
+	if (st.state == TSG_SCHEDULE_RUNNING) {
+		printf("left: %u\n", st.left);
+		printf("next: ");
+		print_time(&st.next);
+	}
+	return 0;
+}
+
+// set compare schedule every USEC from TIME [COUNT]
+static int
+set_periodic(int fd)
+{
+	struct tsg_schedule s = { 0 };
+	char *tok = gettok();
+	char *msg = "schedule looks like: every USEC from TIME [COUNT]";
+
+	if (tok == NULL || sscanf(tok, "%u", &s.period) != 1 ||
+	    (tok = gettok()) == NULL || strcmp(tok, "from") != 0 ||
+	    parse_time(gettok(), &s.start) != 0) {
+		puts(msg);
+		puts(time_msg);
+		return -2;
+	}
+	if ((tok = gettok()) != NULL && sscanf(tok, "%u", &s.repeat) != 1) {
+		puts(msg);
+		return -2;
+	}
+	return tsg_set_schedule(fd, &s);
+}
+
+// set compare schedule at TIME...
+static int
+set_list(int fd)
+{
+	struct tsg_time times[TSG_SCHEDULE_MAX];
+	struct tsg_schedule s = { 0 };
+	char *tok;
+
+	while ((tok = gettok()) != NULL) {
+		if (s.count == TSG_SCHEDULE_MAX) {
+			printf("at most %d times\n", TSG_SCHEDULE_MAX);
+			return -2;
+		}
+		if (parse_time(tok, &times[s.count++]) != 0) {
+			puts(time_msg);
+			return -2;
+		}
+	}
+	if (s.count == 0) {
+		puts("schedule looks like: at TIME...");
+		return -2;
+	}
+	s.times = (uintptr_t)times;
+	return tsg_set_schedule(fd, &s);
+}
+
+static int
+set_stop(int fd)
+{
+	struct tsg_schedule s = { 0 };
+
+	return tsg_set_schedule(fd, &s);
+}
+
+static int
+set_schedule(int fd)
+{
+	static struct node params[] = {
+		{ "every", "strobe periodically", set_periodic },
+		{ "at", "strobe at a list of times", set_list },
+		{ "stop", "stop the schedule", set_stop },
+		{ NULL, NULL, NULL },
+	};
+
+	return walk(params, fd);
+}
+
+int
+wait_compare(int fd)
+{
+	static struct node params[] = {
+		{ "until", "sleep until board time", until },
+		{ NULL, NULL, NULL },
+	};
+
+	return walk(params, fd);
+}
+
 int
 get_compare(int fd)
 {
 	static struct node params[] = {
 		{ "time", "compare time and mask", get_time },
+		{ "schedule", "strobe schedule", get_schedule },
 		{ NULL, NULL, NULL },
 	};
 
@@ -77,6 +228,7 @@ set_compare(int fd)
 {
 	static struct node params[] = {
 		{ "time", "compare time and mask", set_time },
+		{ "schedule", "strobe schedule", set_schedule },
 		{ NULL, NULL, NULL },
 	};
 
@@ -1,2 +1,3 @@
 int get_compare(int fd);
 int set_compare(int fd);
+int wait_compare(int fd);
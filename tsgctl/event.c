@@ -1,6 +1,9 @@
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include "gettok.h"
 #include "node.h"
+#include "tsglib.h"
 #include "event.h"
 
 static int
@@ -30,12 +33,43 @@ get_time(int fd)
 	return 0;
 }
 
+/* these need an event device, eg -d /dev/tsg0.pulse */
+static int
+get_limits(int fd)
+{
+	struct tsg_event_limits l;
+
+	if (tsg_get_event_limits(fd, &l) != 0)
+		return -1;
+	printf("decimate: %u\n", l.decimate);
+	printf("max rate: %u/sec\n", l.max_rate);
+	printf("throttled: %ju\n", (uintmax_t)l.throttled);
+	return 0;
+}
+
+static int
+set_limits(int fd)
+{
+	char *decimate = gettok();
+	char *max_rate = gettok();
+	struct tsg_event_limits l;
+
+	if (decimate == NULL || max_rate == NULL) {
+		printf("expected <decimate> <max rate>\n");
+		return -2;
+	}
+	l.decimate = strtoul(decimate, NULL, 10);
+	l.max_rate = strtoul(max_rate, NULL, 10);
+	return tsg_set_event_limits(fd, &l);
+}
+
 int
 get_event(int fd)
 {
 	static struct node params[] = {
 		{ "source", "event timestamp source", get_source },
 		{ "time", "timestamp", get_time },
+		{ "limits", "decimation and rate limit", get_limits },
 		{ NULL, NULL, NULL },
 	};
 
@@ -47,6 +81,7 @@ set_event(int fd)
 {
 	static struct node params[] = {
 		{ "source", "event timestamp source", set_source },
+		{ "limits", "decimation and rate limit", set_limits },
 		{ NULL, NULL, NULL },
 	};
 
@@ -41,6 +41,23 @@ get_position(int fd)
 	return 0;
 }
 
+// The board keeps positions as degrees, minutes and tenths of seconds,
+// with the hemisphere as a letter. Convert to signed decimal degrees,
+// negative in the south and west, and metres.
+void
+position_to_deg(const struct tsg_position *pos, double *lat, double *lon, double *elev)
+{
+	*lat = pos->lat_deg + pos->lat_min / 60.0 + (pos->lat_sec + pos->lat_decisec / 10.0) / 3600.0;
+	if (pos->lat_dir == 'S')
+		*lat = -*lat;
+	*lon = pos->lon_deg + pos->lon_min / 60.0 + (pos->lon_sec + pos->lon_decisec / 10.0) / 3600.0;
+	if (pos->lon_dir == 'W')
+		*lon = -*lon;
+	*elev = pos->elev_meter + pos->elev_decimeter / 10.0;
+	if (pos->elev_sign == '-')
+		*elev = -*elev;
+}
+
 static int
 get_signal(int fd)
 {
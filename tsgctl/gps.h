@@ -1 +1,4 @@
+struct tsg_position;
+
 int get_gps(int fd);
+void position_to_deg(const struct tsg_position *pos, double *lat, double *lon, double *elev);
@@ -0,0 +1,176 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "gettok.h"
+#include "tsglib.h"
+#include "status.h"
+
+/*
+ * Print the whole board status from one TSG_GET_STATUS ioctl, one
+ * "name: value" per line so monitoring scripts can scrape it.
+ * Fields that don't apply to the board are zero.
+ */
+int
+get_status(int fd)
+{
+	struct tsg_status st;
+	struct tsg_time *t = &st.time;
+
+	if (tsg_get_status(fd, &st) != 0)
+		return -1;
+	printf("model: %x\n", st.model);
+	printf("firmware: %d.%d.%d\n", st.firmware.major, st.firmware.minor, st.firmware.test);
+	printf("test status: 0x%02x\n", st.test_status);
+	printf("phase lock: %s\n", st.lock & TSG_CLOCK_PHASE_LOCK ? "yes" : "no");
+	printf("input valid: %s\n", st.lock & TSG_CLOCK_INPUT_VALID ? "yes" : "no");
+	printf("gps lock: %s\n", st.lock & TSG_CLOCK_GPS_LOCK ? "yes" : "no");
+	printf("reference: 0x%02x\n", st.ref);
+	printf("input timecode: 0x%02x\n", st.timecode);
+	printf("DAC setting: 0x%04x\n", st.dac);
+	printf("leap scheduled: %s\n", st.leap & TSG_INSERT_LEAP ? "yes" : "no");
+	printf("DST: %s\n", st.dst ? "yes" : "no");
+	printf("generator stopped: %s\n", st.stop ? "yes" : "no");
+	printf("use timecode quality: %s\n", st.use_quality ? "yes" : "no");
+	printf("timecode source locked: %s\n", st.quality.locked ? "yes" : "no");
+	printf("timecode source quality level: %d\n", st.quality.level);
+	printf("antenna shorted: %s\n", st.antenna & TSG_GPS_ANTENNA_SHORTED ? "yes" : "no");
+	printf("antenna open: %s\n", st.antenna & TSG_GPS_ANTENNA_OPEN ? "yes" : "no");
+	printf("interrupt mask: 0x%02x\n", st.intmask);
+	printf(
+		"time: %d-%d-%02d:%02d:%02d.%09ld\n",
+		t->year,
+		t->day,
+		t->hour,
+		t->min,
+		t->sec,
+		(unsigned long)t->nsec
+	);
+	return 0;
+}
+
+int
+get_watch(int fd)
+{
+	uint32_t ms;
+
+	if (tsg_get_watch_interval(fd, &ms) != 0)
+		return -1;
+	printf("watch interval: %u msec\n", ms);
+	return 0;
+}
+
+int
+set_watch(int fd)
+{
+	char *tok = gettok();
+	uint32_t ms;
+
+	if (tok == NULL || sscanf(tok, "%u", &ms) != 1) {
+		puts("watch interval is in msec, 0 to stop");
+		return -2;
+	}
+	return tsg_set_watch_interval(fd, &ms);
+}
+
+/*
+ * Print status changes as the driver reports them, until interrupted.
+ * The driver only queues changes made after the device was opened.
+ */
+int
+watch_status(int fd)
+{
+	struct tsg_status_change c;
+	uint32_t next = 0;
+	ssize_t n;
+
+	while ((n = read(fd, &c, sizeof(c))) == sizeof(c)) {
+		if (next != 0 && c.sequence != next)
+			printf("lost %u changes\n", c.sequence - next);
+		next = c.sequence + 1;
+		printf(
+			"%jd.%09u changed 0x%02x: lock 0x%02x antenna 0x%02x quality %s/%d test 0x%02x\n",
+			(intmax_t)c.timestamp.sec,
+			c.timestamp.nsec,
+			c.changed,
+			c.lock,
+			c.antenna,
+			c.quality.locked ? "locked" : "unlocked",
+			c.quality.level,
+			c.test_status
+		);
+		fflush(stdout);
+	}
+	return n < 0 ? -1 : 0;
+}
+
+// one line per sample: time, DAC, lock, antenna, quality, test status, and
+// sv:C/N0 for each satellite
+static void
+print_telemetry(struct tsg_telemetry *t)
+{
+	int i;
+
+	printf(
+		"%jd.%09u dac 0x%04x lock 0x%02x antenna 0x%02x quality %s/%d test 0x%02x",
+		(intmax_t)t->timestamp.sec,
+		t->timestamp.nsec,
+		t->dac,
+		t->lock,
+		t->antenna,
+		t->quality.locked ? "locked" : "unlocked",
+		t->quality.level,
+		t->test_status
+	);
+	if (t->flags & TSG_TELEMETRY_SIGNAL)
+		for (i = 0; i < TSG_MAX_SATELLITES; ++i)
+			printf(" %d:%d.%02d",
+			    t->signal.satellites[i].sv,
+			    t->signal.satellites[i].level,
+			    t->signal.satellites[i].centilevel);
+	printf("\n");
+}
+
+/*
+ * get telemetry: the driver's latest sample
+ * get telemetry history [N]: the last N (default all) once a second samples
+ */
+int
+get_telemetry(int fd)
+{
+	struct tsg_telemetry_current cur;
+	struct tsg_telemetry_history h;
+	struct tsg_telemetry *samples;
+	char *tok = gettok();
+	uint32_t i;
+
+	if (tok == NULL) {
+		if (tsg_get_telemetry(fd, &cur) != 0)
+			return -1;
+		printf("age: %u msec\n", cur.age_ms);
+		print_telemetry(&cur.sample);
+		return 0;
+	}
+	if (strcmp(tok, "history") != 0) {
+		puts("telemetry looks like: [history [N]]");
+		return -2;
+	}
+	h.count = TSG_TELEMETRY_HISTORY;
+	if ((tok = gettok()) != NULL && sscanf(tok, "%u", &h.count) != 1) {
+		puts("telemetry looks like: [history [N]]");
+		return -2;
+	}
+	if ((samples = calloc(h.count, sizeof(*samples))) == NULL)
+		return -1;
+	h.pad = 0;
+	h.samples = (uintptr_t)samples;
+	if (tsg_get_telemetry_history(fd, &h) != 0) {
+		free(samples);
+		return -1;
+	}
+	for (i = 0; i < h.count; ++i)
+		print_telemetry(&samples[i]);
+	free(samples);
+	return 0;
+}
@@ -0,0 +1,5 @@
+int get_status(int fd);
+int get_watch(int fd);
+int set_watch(int fd);
+int watch_status(int fd);
+int get_telemetry(int fd);
@@ -0,0 +1,135 @@
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "gettok.h"
+#include "tsglib.h"
+#include "gps.h"
+#include "survey.h"
+
+/*
+ * Survey-in: average the receiver's position fixes over hours and report
+ * the mean, which is the antenna position to give the receiver for
+ * position-hold timing. The driver can't preset it (TSG_SET_GPS_POSITION
+ * is not supported), so that is left to the receiver's own tools.
+ *
+ * Fixes are taken once a second, as metres north, east and up from the
+ * first one, and the mean and variance kept with Welford's method.
+ * Successive fixes are strongly correlated, so the standard error of the
+ * mean would be far too optimistic; instead the survey has converged once
+ * the mean has moved less than the tolerance over the last hour. It gives
+ * up after four times the minimum survey time, or four hours.
+ *
+ * The position registers hold tenths of an arcsecond, about 3.1m north to
+ * south, so a tolerance below that is refused.
+ */
+
+#define	EARTH_RADIUS	6371000.0	// metres
+#define	DEG		(M_PI / 180)
+#define	RESOLUTION	(0.1 / 3600 * DEG * EARTH_RADIUS)	// metres
+#define	MAX_ERRORS	60		// consecutive failed reads before giving up
+
+struct axis {
+	double	mean;
+	double	m2;			// sum of squared differences from the mean
+};
+
+static void
+axis_add(struct axis *a, uint64_t n, double x)
+{
+	double d = x - a->mean;
+
+	a->mean += d / n;
+	a->m2 += d * (x - a->mean);
+}
+
+static double
+axis_stddev(const struct axis *a, uint64_t n)
+{
+	return n > 1 ? sqrt(a->m2 / (n - 1)) : 0;
+}
+
+int
+survey_gps(int fd)
+{
+	char *tok, *end;
+	double hours, tol = RESOLUTION;
+	double lat0, lon0, elev0, lat, lon, elev, coslat0;
+	double hour_mean[3], moved;
+	struct axis ax[3] = { { 0, 0 }, { 0, 0 }, { 0, 0 } };	// north, east, up
+	struct tsg_position pos;
+	uint64_t n = 0;
+	unsigned secs, errors = 0;
+
+	if ((tok = gettok()) == NULL || (hours = strtod(tok, &end)) <= 0 || *end != '\0') {
+		puts("expected the minimum number of hours to survey, and optionally a tolerance in metres");
+		return -2;
+	}
+	if ((tok = gettok()) != NULL && ((tol = strtod(tok, &end)) < RESOLUTION || *end != '\0')) {
+		printf("the tolerance is in metres, and no finer than the %.1fm the board resolves\n", RESOLUTION);
+		return -2;
+	}
+
+	if (tsg_get_gps_position(fd, &pos) != 0)
+		return -1;
+	position_to_deg(&pos, &lat0, &lon0, &elev0);
+	coslat0 = cos(lat0 * DEG);
+
+	for (secs = 1; ; ++secs) {
+		sleep(1);
+		if (tsg_get_gps_position(fd, &pos) != 0) {
+			// the position registers were changing under us
+			if (++errors == MAX_ERRORS)
+				return -1;
+			continue;
+		}
+		errors = 0;
+		position_to_deg(&pos, &lat, &lon, &elev);
+		n++;
+		axis_add(&ax[0], n, (lat - lat0) * DEG * EARTH_RADIUS);
+		axis_add(&ax[1], n, (lon - lon0) * DEG * EARTH_RADIUS * coslat0);
+		axis_add(&ax[2], n, elev - elev0);
+
+		if (secs % 60 == 0)
+			printf(
+				"%u min: %ju fixes, mean %.7f %.7f %.1fm, stddev n %.1fm e %.1fm u %.1fm\n",
+				secs / 60,
+				(uintmax_t)n,
+				lat0 + ax[0].mean / EARTH_RADIUS / DEG,
+				lon0 + ax[1].mean / EARTH_RADIUS / coslat0 / DEG,
+				elev0 + ax[2].mean,
+				axis_stddev(&ax[0], n),
+				axis_stddev(&ax[1], n),
+				axis_stddev(&ax[2], n)
+			);
+		if (secs % 3600 != 0)
+			continue;
+
+		if (secs > 3600) {
+			moved = sqrt(pow(ax[0].mean - hour_mean[0], 2) +
+			    pow(ax[1].mean - hour_mean[1], 2) +
+			    pow(ax[2].mean - hour_mean[2], 2));
+			printf("mean moved %.2fm in the last hour\n", moved);
+			if (secs >= hours * 3600 && moved < tol)
+				break;
+			if (secs >= hours * 4 * 3600 && secs >= 4 * 3600) {
+				printf("no convergence to %.2fm\n", tol);
+				errno = ETIMEDOUT;
+				return -1;
+			}
+		}
+		hour_mean[0] = ax[0].mean;
+		hour_mean[1] = ax[1].mean;
+		hour_mean[2] = ax[2].mean;
+	}
+
+	lat = lat0 + ax[0].mean / EARTH_RADIUS / DEG;
+	lon = lon0 + ax[1].mean / EARTH_RADIUS / coslat0 / DEG;
+	elev = elev0 + ax[2].mean;
+	printf("position %.7f %.7f %.1fm from %ju fixes, stddev n %.1fm e %.1fm u %.1fm\n",
+	    lat, lon, elev, (uintmax_t)n,
+	    axis_stddev(&ax[0], n), axis_stddev(&ax[1], n), axis_stddev(&ax[2], n));
+	return 0;
+}
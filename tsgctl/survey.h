@@ -0,0 +1 @@
+int survey_gps(int fd);
@@ -6,6 +6,11 @@
  * into other languages like Go or Tcl later. We'll see.
  */
 
+#include <stdatomic.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "../tsg/tsg.h"
 
 int
@@ -110,6 +115,40 @@ tsg_set_clock_time(int fd, struct tsg_time *p)
 	return ioctl(fd, TSG_SET_CLOCK_TIME, p);
 }
 
+int
+tsg_get_clock_preset(int fd, struct tsg_preset_status *p)
+{
+	return ioctl(fd, TSG_GET_CLOCK_PRESET, p);
+}
+
+/* wait up to timeout_ms for a preset started on fd to finish, then get its status */
+int
+tsg_wait_clock_preset(int fd, int timeout_ms, struct tsg_preset_status *p)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+	switch (poll(&pfd, 1, timeout_ms)) {
+	case -1:
+		return -1;
+	case 0:
+		errno = ETIMEDOUT;
+		return -1;
+	}
+	return tsg_get_clock_preset(fd, p);
+}
+
+int
+tsg_get_clock_offset(int fd, struct tsg_clock_offset *p)
+{
+	return ioctl(fd, TSG_GET_CLOCK_OFFSET, p);
+}
+
+int
+tsg_get_clock_time_cycles(int fd, struct tsg_time_cycles *p)
+{
+	return ioctl(fd, TSG_GET_CLOCK_TIME_CYCLES, p);
+}
+
 int
 tsg_get_gps_position(int fd, struct tsg_position *p)
 {
@@ -266,6 +305,48 @@ tsg_set_compare_time(int fd, struct tsg_compare_time *p)
 	return ioctl(fd, TSG_SET_COMPARE_TIME, p);
 }
 
+int
+tsg_wait_until(int fd, struct tsg_time *p)
+{
+	return ioctl(fd, TSG_WAIT_UNTIL, p);
+}
+
+int
+tsg_set_schedule(int fd, struct tsg_schedule *p)
+{
+	return ioctl(fd, TSG_SET_SCHEDULE, p);
+}
+
+int
+tsg_get_schedule(int fd, struct tsg_schedule_status *p)
+{
+	return ioctl(fd, TSG_GET_SCHEDULE, p);
+}
+
+int
+tsg_get_watch_interval(int fd, uint32_t *p)
+{
+	return ioctl(fd, TSG_GET_WATCH_INTERVAL, p);
+}
+
+int
+tsg_set_watch_interval(int fd, uint32_t *p)
+{
+	return ioctl(fd, TSG_SET_WATCH_INTERVAL, p);
+}
+
+int
+tsg_get_telemetry(int fd, struct tsg_telemetry_current *p)
+{
+	return ioctl(fd, TSG_GET_TELEMETRY, p);
+}
+
+int
+tsg_get_telemetry_history(int fd, struct tsg_telemetry_history *p)
+{
+	return ioctl(fd, TSG_GET_TELEMETRY_HISTORY, p);
+}
+
 int
 tsg_get_int_mask(int fd, uint8_t *p)
 {
@@ -283,3 +364,90 @@ tsg_get_latched_time(int fd, struct tsg_time *p)
 {
 	return ioctl(fd, TSG_GET_LATCHED_TIME, p);
 }
+
+int
+tsg_get_latched_time_cycles(int fd, struct tsg_time_cycles *p)
+{
+	return ioctl(fd, TSG_GET_LATCHED_TIME_CYCLES, p);
+}
+
+int
+tsg_get_event_stats(int fd, struct tsg_event_stats *p)
+{
+	return ioctl(fd, TSG_GET_EVENT_STATS, p);
+}
+
+int
+tsg_wait_event(int fd, struct tsg_event_wait *p)
+{
+	return ioctl(fd, TSG_WAIT_EVENT, p);
+}
+
+int
+tsg_get_event_limits(int fd, struct tsg_event_limits *p)
+{
+	return ioctl(fd, TSG_GET_EVENT_LIMITS, p);
+}
+
+int
+tsg_set_event_limits(int fd, struct tsg_event_limits *p)
+{
+	return ioctl(fd, TSG_SET_EVENT_LIMITS, p);
+}
+
+int
+tsg_batch(int fd, struct tsg_batch *p)
+{
+	return ioctl(fd, TSG_BATCH, p);
+}
+
+int
+tsg_get_status(int fd, struct tsg_status *p)
+{
+	return ioctl(fd, TSG_GET_STATUS, p);
+}
+
+int
+tsg_start_bench(int fd, struct tsg_bench_config *p)
+{
+	return ioctl(fd, TSG_START_BENCH, p);
+}
+
+int
+tsg_get_bench(int fd, struct tsg_bench_result *p)
+{
+	return ioctl(fd, TSG_GET_BENCH, p);
+}
+
+/* map the latest-event page of an event device (eg /dev/tsg0.ext) */
+struct tsg_event_page *
+tsg_map_event_page(int fd)
+{
+	void *p = mmap(NULL, getpagesize(), PROT_READ, MAP_SHARED, fd, 0);
+
+	return p == MAP_FAILED ? NULL : p;
+}
+
+int
+tsg_unmap_event_page(struct tsg_event_page *pg)
+{
+	return munmap(pg, getpagesize());
+}
+
+/* copy a consistent snapshot of the latest event; never blocks or syscalls */
+void
+tsg_read_event_page(struct tsg_event_page *pg, struct tsg_event *ev)
+{
+	uint32_t seq;
+
+	for (;;) {
+		seq = pg->seq;
+		atomic_thread_fence(memory_order_acquire);
+		if (seq & 1)
+			continue;	// driver is half way through an update
+		*ev = pg->event;
+		atomic_thread_fence(memory_order_acquire);
+		if (pg->seq == seq)
+			return;
+	}
+}
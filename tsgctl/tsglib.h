@@ -25,6 +25,10 @@ int tsg_get_clock_ref(int fd, uint8_t *p);
 int tsg_set_clock_ref(int fd, uint8_t *p);
 int tsg_get_clock_time(int fd, struct tsg_time *p);
 int tsg_set_clock_time(int fd, struct tsg_time *p);
+int tsg_get_clock_preset(int fd, struct tsg_preset_status *p);
+int tsg_wait_clock_preset(int fd, int timeout_ms, struct tsg_preset_status *p);
+int tsg_get_clock_offset(int fd, struct tsg_clock_offset *p);
+int tsg_get_clock_time_cycles(int fd, struct tsg_time_cycles *p);
 int tsg_get_gps_position(int fd, struct tsg_position *p);
 int tsg_get_gps_signal(int fd, struct tsg_signal *p);
 int tsg_get_timecode_agc_delays(int fd, struct tsg_agc_delays *p);
@@ -51,8 +55,27 @@ int tsg_get_synth_enable(int fd, uint8_t *p);
 int tsg_set_synth_enable(int fd, uint8_t *p);
 int tsg_get_compare_time(int fd, struct tsg_compare_time *p);
 int tsg_set_compare_time(int fd, struct tsg_compare_time *p);
+int tsg_wait_until(int fd, struct tsg_time *p);
+int tsg_set_schedule(int fd, struct tsg_schedule *p);
+int tsg_get_schedule(int fd, struct tsg_schedule_status *p);
 int tsg_get_int_mask(int fd, uint8_t *p);
 int tsg_set_int_mask(int fd, uint8_t *p);
 int tsg_get_latched_time(int fd, struct tsg_time *p);
+int tsg_get_latched_time_cycles(int fd, struct tsg_time_cycles *p);
+int tsg_get_event_stats(int fd, struct tsg_event_stats *p);
+int tsg_wait_event(int fd, struct tsg_event_wait *p);
+int tsg_get_event_limits(int fd, struct tsg_event_limits *p);
+int tsg_set_event_limits(int fd, struct tsg_event_limits *p);
+int tsg_batch(int fd, struct tsg_batch *p);
+int tsg_get_status(int fd, struct tsg_status *p);
+int tsg_get_watch_interval(int fd, uint32_t *p);
+int tsg_set_watch_interval(int fd, uint32_t *p);
+int tsg_get_telemetry(int fd, struct tsg_telemetry_current *p);
+int tsg_get_telemetry_history(int fd, struct tsg_telemetry_history *p);
+int tsg_start_bench(int fd, struct tsg_bench_config *p);
+int tsg_get_bench(int fd, struct tsg_bench_result *p);
+struct tsg_event_page *tsg_map_event_page(int fd);
+int tsg_unmap_event_page(struct tsg_event_page *pg);
+void tsg_read_event_page(struct tsg_event_page *pg, struct tsg_event *ev);
 
 #endif
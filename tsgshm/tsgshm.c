@@ -128,27 +128,22 @@ main(int argc, char **argv)
 	shmp->valid = 0;
 
 	for (;;) {
-		pps_info_t info;
-		struct tsg_time t;
-		uint8_t ref, lock;
+		struct tsg_event_wait w = {
+			.timeout_ms = TSG_WAIT_FOREVER
+		};
 
-		if (time_pps_fetch(handle, PPS_TSFMT_TSPEC, &info, NULL) != 0) {
-			perror("time_pps_fetch");
-			exit(1);
-		}
-		if (ioctl(fd, TSG_GET_LATCHED_TIME, &t) != 0) {
-			perror("TSG_GET_LATCHED_TIME");
+		// one call gets the PPS timestamp, latched board time and
+		// board status, all as they were when the event happened
+		if (ioctl(fd, TSG_WAIT_EVENT, &w) != 0) {
+			perror("TSG_WAIT_EVENT");
 			exit(1);
 		}
 
-		if (ioctl(fd, TSG_GET_CLOCK_REF, &ref) != 0) {
-			perror("TSG_GET_CLOCK_REF");
-			exit(1);
-		}
-		if (ioctl(fd, TSG_GET_CLOCK_LOCK, &lock) != 0) {
-			perror("TSG_GET_CLOCK_LOCK");
-			exit(1);
-		}
+		struct tsg_event *ev = &w.event;
+		struct tsg_time t = ev->time;
+		struct timespec sys = { .tv_sec = ev->timestamp.sec, .tv_nsec = ev->timestamp.nsec };
+		uint8_t ref = ev->ref;
+		uint8_t lock = ev->lock;
 
 		if (ref == TSG_CLOCK_REF_GEN)
 			newstate = STATE_NA;
@@ -171,6 +166,16 @@ main(int argc, char **argv)
 			}
 		}
 
+		// For pulse and synth events the driver knows when the edge
+		// itself happened. Use that, and take the latency the board
+		// measured off the system time too, so both still describe the
+		// same moment: the edge.
+		if (ev->flags & TSG_EVENT_EDGE) {
+			struct timespec lat = { .tv_sec = 0, .tv_nsec = ev->latency };
+			t = ev->edge;
+			timespecsub(&sys, &lat, &sys);
+		}
+
 		// convert board day of month month and day
 		int mon, day;
 		doy2monthday(t.year, t.day, &mon, &day);
@@ -197,9 +202,9 @@ main(int argc, char **argv)
 			// populate SHM for ntpd to pick up
 			// need memory barriers?
 			shmp->valid = 0;
-			shmp->receiveTimeStampSec = info.assert_timestamp.tv_sec;
-			shmp->receiveTimeStampUSec = info.assert_timestamp.tv_nsec / 1000;
-			shmp->receiveTimeStampNSec = info.assert_timestamp.tv_nsec;
+			shmp->receiveTimeStampSec = sys.tv_sec;
+			shmp->receiveTimeStampUSec = sys.tv_nsec / 1000;
+			shmp->receiveTimeStampNSec = sys.tv_nsec;
 
 			shmp->clockTimeStampSec = brd.tv_sec;
 			shmp->clockTimeStampUSec = brd.tv_nsec / 1000;
@@ -223,11 +228,13 @@ main(int argc, char **argv)
 				break;
 			}
 
-			printf("assert %d count %d %s\n", info.assert_sequence, shmp->count, msg);
-			printf("\tsys: %d.%09ld\n", info.assert_timestamp.tv_sec, info.assert_timestamp.tv_nsec);
+			printf("assert %d count %d %s\n", ev->sequence, shmp->count, msg);
+			printf("\tsys: %d.%09ld\n", sys.tv_sec, sys.tv_nsec);
 			printf("\tbrd: %d.%09ld\n", brd.tv_sec, brd.tv_nsec);
+			if (ev->flags & TSG_EVENT_EDGE)
+				printf("\tlat: %u nsec\n", ev->latency);
 			struct timespec diff;
-			timespecsub(&brd, &info.assert_timestamp, &diff);
+			timespecsub(&brd, &sys, &diff);
 			printf("\tdif: %02d.%09ld\n", diff.tv_sec, diff.tv_nsec);
 		}
 	}
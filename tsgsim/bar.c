@@ -0,0 +1,330 @@
+/*
+ * bar.c -- the card's two BARs as an in-memory register file
+ *
+ * Most registers are plain memory, with the card's firmware reduced to
+ * what the driver depends on:
+ *	- writing 0xfc latches the board time into 0xfc-0x107
+ *	- the hardware control register enables events, and its clear bits
+ *	  clear them in the hardware status register
+ *	- the preset, DAC save and synth load bits clear themselves at once
+ *	- the interrupt is raised while an enabled event is pending and the
+ *	  PLX 9050 has interrupts enabled in INTCSR
+ * Board time starts at 2026 day 290 12:00:00 and moves with sim_advance().
+ * The synth frequency starts at sim_card.synth_freq.
+ *
+ * Each bus_* call is one transaction per byte or word moved, as on the
+ * card, and is charged sim_latency.
+ */
+
+#include "kern.h"
+#include "tsg.h"
+#include "layout.c"
+#include "sim.h"
+
+// as in tsg.c
+#define	LCR_INTCSR		0x4c
+#define		LCR_INTCSR_PCI_ENABLE	0x40
+#define	REG_HARDWARE_CONTROL	0xf8
+#define	REG_LATCH		0xfc
+#define	REG_HARDWARE_STATUS	0xfe
+#define	REG_LOCK_STATUS		0x105
+#define	REG_CONFIG		0x118
+#define		TSG_PRESET_TIME_READY	0x04
+#define		TSG_PRESET_POS_READY	0x80
+#define	REG_TIMECODE_QUALITY	0x11d
+#define	REG_MISC_CONTROL	0x12c
+#define	REG_SYNTH_FREQ		0x128
+#define	REG_SYNTH_CONTROL	0x12d
+#define		TSG_SYNTH_LOAD		0x02
+#define	REG_FIRMWARE		0x1bc
+
+struct sim_latency sim_latency = { 1000, 250, true };
+struct sim_card sim_card = { 0 };
+
+struct resource {
+	int			bar;
+	uint8_t			*regs;
+	bus_size_t		size;
+	struct sim_barstats	stats;
+};
+
+static uint8_t lcr[0x80];
+static uint8_t registers[0x200];
+static struct resource bars[] = {
+	{ 0, lcr, sizeof(lcr) },
+	{ 2, registers, sizeof(registers) },
+};
+
+// serialises the board model; the driver's own locks don't cover every
+// register
+static pthread_mutex_t bar_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static uint16_t board_year;
+static uint16_t board_day;
+static uint64_t board_nsec;	// into the day
+
+void
+bar_init(uint16_t model)
+{
+	int i;
+
+	memset(lcr, 0, sizeof(lcr));
+	memset(registers, 0, sizeof(registers));
+	for (i = 0; i < nitems(bars); ++i)
+		memset(&bars[i].stats, 0, sizeof(bars[i].stats));
+
+	board_year = 2026;
+	board_day = 290;
+	board_nsec = 12 * 3600 * 1000000000ULL;
+
+	// locked to a valid input, with the timecode at its best
+	registers[REG_LOCK_STATUS] = (TSG_CLOCK_PHASE_LOCK | TSG_CLOCK_INPUT_VALID |
+	    (model == TSG_MODEL_GPS_PCI || model == TSG_MODEL_GPS_PCI_2U ? TSG_CLOCK_GPS_LOCK : 0)) << 4;
+	registers[REG_TIMECODE_QUALITY] = 0x80;
+	if (model == TSG_MODEL_PCI_SG_2U || model == TSG_MODEL_GPS_PCI_2U) {
+		registers[REG_FIRMWARE] = 6;
+		for (i = 0; i < 4; ++i)
+			registers[REG_SYNTH_FREQ + i] = sim_card.synth_freq >> (8 * i);
+	}
+}
+
+struct resource *
+bar_alloc(int bar)
+{
+	int i;
+
+	for (i = 0; i < nitems(bars); ++i)
+		if (bars[i].bar == bar)
+			return &bars[i];
+	return NULL;
+}
+
+void
+bar_release(struct resource *r)
+{
+}
+
+void
+bar_advance(uint32_t nsec)
+{
+	uint16_t days;
+
+	pthread_mutex_lock(&bar_mtx);
+	board_nsec += nsec;
+	while (board_nsec >= 86400 * 1000000000ULL) {
+		board_nsec -= 86400 * 1000000000ULL;
+		days = (board_year % 4 == 0 && (board_year % 100 != 0 || board_year % 400 == 0)) ? 366 : 365;
+		if (++board_day > days) {
+			board_day = 1;
+			board_year++;
+		}
+	}
+	pthread_mutex_unlock(&bar_mtx);
+}
+
+// the status byte and the lock status nibble share the latch block, and
+// keep their own values
+static void
+latch(void)
+{
+	struct bcd_time t;
+	uint64_t ns = board_nsec;
+	uint32_t s = ns / 1000000000;
+
+	ns %= 1000000000;
+	t.unused0 = registers[REG_HARDWARE_STATUS] >> 4;
+	t.unused1 = registers[REG_HARDWARE_STATUS] & 0x0f;
+	t.unused2 = registers[REG_HARDWARE_STATUS + 1] & 0x0f;
+	t.unused3 = registers[REG_LOCK_STATUS] >> 4;
+	t.thousands_year = board_year / 1000;
+	t.hundreds_year = board_year / 100 % 10;
+	t.tens_year = board_year / 10 % 10;
+	t.units_year = board_year % 10;
+	t.hundreds_day = board_day / 100;
+	t.tens_day = board_day / 10 % 10;
+	t.units_day = board_day % 10;
+	t.tens_hour = s / 36000;
+	t.units_hour = s / 3600 % 10;
+	t.tens_min = s / 600 % 6;
+	t.units_min = s / 60 % 10;
+	t.tens_sec = s % 60 / 10;
+	t.units_sec = s % 10;
+	t.hundreds_milli = ns / 100000000;
+	t.tens_milli = ns / 10000000 % 10;
+	t.units_milli = ns / 1000000 % 10;
+	t.hundreds_micro = ns / 100000 % 10;
+	t.tens_micro = ns / 10000 % 10;
+	t.units_micro = ns / 1000 % 10;
+	t.hundreds_nano = ns / 100 % 10;
+	bcd_time_encode(&registers[REG_LATCH], &t);
+}
+
+// the TSG_INTR_* bits each TSG_INT_ENABLE_* bit lets through, and those
+// each TSG_CLEAR_* bit clears
+static uint8_t
+enabled(uint8_t control)
+{
+	return (control & TSG_INT_ENABLE_EXT ? 0x01 : 0) |
+	    (control & TSG_INT_ENABLE_COMPARE ? 0x02 : 0) |
+	    (control & TSG_INT_ENABLE_PULSE ? 0x04 : 0) |
+	    (control & TSG_INT_ENABLE_SYNTH ? 0x08 : 0);
+}
+
+static uint8_t
+cleared(uint8_t control)
+{
+	return (control & 0x01 ? 0x01 : 0) | (control & 0x02 ? 0x02 : 0) |
+	    (control & 0x04 ? 0x04 : 0) | (control & 0x40 ? 0x08 : 0);
+}
+
+static bool
+irq_asserted(void)
+{
+	return (lcr[LCR_INTCSR] & LCR_INTCSR_PCI_ENABLE) &&
+	    (registers[REG_HARDWARE_STATUS] & enabled(registers[REG_HARDWARE_CONTROL]));
+}
+
+static void
+store(struct resource *r, bus_size_t off, uint8_t v)
+{
+	if (r->regs == lcr) {
+		lcr[off] = v;
+		return;
+	}
+	switch (off) {
+	case REG_LATCH:
+		latch();
+		break;
+	case REG_HARDWARE_CONTROL:
+		registers[REG_HARDWARE_STATUS] &= ~cleared(v);
+		registers[off] = v & TSG_INT_ENABLE_MASK;
+		break;
+	case REG_CONFIG:
+		registers[off] = v & ~(TSG_PRESET_TIME_READY | TSG_PRESET_POS_READY);
+		break;
+	case REG_MISC_CONTROL:
+		registers[off] = v & ~TSG_SAVE_DAC;
+		break;
+	case REG_SYNTH_CONTROL:
+		registers[off] = v & ~TSG_SYNTH_LOAD;
+		break;
+	default:
+		// the rest of the latch block is read only
+		if (off < REG_LATCH || off > REG_LOCK_STATUS + 2)
+			registers[off] = v;
+		break;
+	}
+}
+
+static void
+spin(uint32_t nsec)
+{
+	struct timespec t0, t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	do
+		clock_gettime(CLOCK_MONOTONIC, &t);
+	while ((t.tv_sec - t0.tv_sec) * 1000000000LL + t.tv_nsec - t0.tv_nsec < nsec);
+}
+
+// charge one transaction of width bytes at off
+static void
+transaction(struct resource *r, bus_size_t off, int width, bool write)
+{
+	uint32_t nsec = write ? sim_latency.write_ns : sim_latency.read_ns;
+
+	if (off % width != 0 || off + width > r->size) {
+		fprintf(stderr, "tsgsim: bad %d byte %s at BAR%d+%#lx\n",
+		    width, write ? "write" : "read", r->bar, (u_long)off);
+		abort();
+	}
+	if (write)
+		r->stats.writes++;
+	else
+		r->stats.reads++;
+	r->stats.nsec += nsec;
+	if (sim_latency.spin)
+		spin(nsec);
+}
+
+uint8_t
+bus_read_1(struct resource *r, bus_size_t off)
+{
+	uint8_t v;
+
+	pthread_mutex_lock(&bar_mtx);
+	transaction(r, off, 1, false);
+	v = r->regs[off];
+	pthread_mutex_unlock(&bar_mtx);
+	return v;
+}
+
+void
+bus_write_1(struct resource *r, bus_size_t off, uint8_t v)
+{
+	pthread_mutex_lock(&bar_mtx);
+	transaction(r, off, 1, true);
+	store(r, off, v);
+	pthread_mutex_unlock(&bar_mtx);
+}
+
+void
+bus_read_region_1(struct resource *r, bus_size_t off, uint8_t *buf, bus_size_t n)
+{
+	for (; n > 0; --n)
+		*buf++ = bus_read_1(r, off++);
+}
+
+void
+bus_write_region_1(struct resource *r, bus_size_t off, const uint8_t *buf, bus_size_t n)
+{
+	for (; n > 0; --n)
+		bus_write_1(r, off++, *buf++);
+}
+
+void
+bus_read_region_4(struct resource *r, bus_size_t off, uint32_t *buf, bus_size_t n)
+{
+	pthread_mutex_lock(&bar_mtx);
+	for (; n > 0; --n, off += 4) {
+		transaction(r, off, 4, false);
+		*buf++ = le32dec(&r->regs[off]);
+	}
+	pthread_mutex_unlock(&bar_mtx);
+}
+
+void
+bus_write_region_4(struct resource *r, bus_size_t off, const uint32_t *buf, bus_size_t n)
+{
+	int i;
+
+	pthread_mutex_lock(&bar_mtx);
+	for (; n > 0; --n, off += 4, ++buf) {
+		transaction(r, off, 4, true);
+		for (i = 0; i < 4; ++i)
+			store(r, off + i, *buf >> 8 * i);
+	}
+	pthread_mutex_unlock(&bar_mtx);
+}
+
+void
+sim_bar_stats(int bar, struct sim_barstats *st)
+{
+	struct resource *r = bar_alloc(bar);
+
+	pthread_mutex_lock(&bar_mtx);
+	*st = r->stats;
+	pthread_mutex_unlock(&bar_mtx);
+}
+
+int
+sim_edge(uint8_t events, struct sim_intr_time *t)
+{
+	bool raise;
+
+	pthread_mutex_lock(&bar_mtx);
+	registers[REG_HARDWARE_STATUS] |= events;
+	raise = irq_asserted();
+	pthread_mutex_unlock(&bar_mtx);
+	return raise ? sim_interrupt(t) : 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * ioccom.h -- FreeBSD ioctl command encoding, for Linux
+ *
+ * The driver takes the command group, number and argument length apart
+ * the FreeBSD way (IOCBASECMD(), IOCPARM_LEN()), so the simulator and its
+ * callers must build tsg.h's commands the same way. Include this before
+ * tsg.h.
+ */
+
+#ifndef _TSGSIM_IOCCOM_H
+#define	_TSGSIM_IOCCOM_H
+
+#include <sys/ioctl.h>
+
+#undef	_IOC
+#undef	_IO
+#undef	_IOR
+#undef	_IOW
+#undef	_IOWR
+#undef	IOC_IN
+#undef	IOC_OUT
+#undef	IOC_INOUT
+
+#define	IOCPARM_SHIFT	13
+#define	IOCPARM_MASK	((1 << IOCPARM_SHIFT) - 1)
+#define	IOCPARM_LEN(x)	(((x) >> 16) & IOCPARM_MASK)
+#define	IOCBASECMD(x)	((x) & ~(IOCPARM_MASK << 16))
+#define	IOCGROUP(x)	(((x) >> 8) & 0xff)
+#define	IOCPARM_MAX	(1 << IOCPARM_SHIFT)
+
+#define	IOC_VOID	0x20000000UL
+#define	IOC_OUT		0x40000000UL
+#define	IOC_IN		0x80000000UL
+#define	IOC_INOUT	(IOC_IN|IOC_OUT)
+
+#define	_IOC(inout, group, num, len)	((unsigned long)		\
+	((inout) | (((len) & IOCPARM_MASK) << 16) | ((group) << 8) | (num)))
+#define	_IO(g, n)	_IOC(IOC_VOID, (g), (n), 0)
+#define	_IOR(g, n, t)	_IOC(IOC_OUT, (g), (n), sizeof(t))
+#define	_IOW(g, n, t)	_IOC(IOC_IN, (g), (n), sizeof(t))
+#define	_IOWR(g, n, t)	_IOC(IOC_INOUT, (g), (n), sizeof(t))
+
+#endif
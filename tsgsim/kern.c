@@ -0,0 +1,1127 @@
+/*
+ * kern.c -- the kernel interface of kern.h, on top of pthreads and libc,
+ * and the harness side of it: attaching the driver, opening its devices,
+ * running ioctls the way ioctl(2) would, advancing virtual time, and
+ * reading the sysctl tree the driver builds.
+ */
+
+#define	_GNU_SOURCE	// memfd_create()
+
+#include <assert.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "kern.h"
+#include "sim.h"
+
+#undef	malloc
+#undef	free
+
+int ticks;
+FILE *sim_tty;
+struct taskqueue *taskqueue_thread;
+
+static void
+fail(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	fprintf(stderr, "tsgsim: ");
+	vfprintf(stderr, fmt, ap);
+	fprintf(stderr, "\n");
+	va_end(ap);
+	abort();
+}
+
+/*
+ * time
+ */
+
+sbintime_t
+sbinuptime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (sbintime_t)ts.tv_sec << 32 | ((uint64_t)ts.tv_nsec << 32) / 1000000000;
+}
+
+void
+nanotime(struct timespec *ts)
+{
+	clock_gettime(CLOCK_REALTIME, ts);
+}
+
+uint64_t
+get_cyclecount(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+int
+tvtohz(struct timeval *tv)
+{
+	return tv->tv_sec * hz + (tv->tv_usec * hz + 999999) / 1000000 + 1;
+}
+
+/*
+ * memory
+ */
+
+void *
+sim_malloc(size_t size, int flags)
+{
+	void *p;
+
+	// page sized allocations are page aligned in the kernel too
+	if (size >= PAGE_SIZE) {
+		if (posix_memalign(&p, PAGE_SIZE, size) != 0)
+			p = NULL;
+	} else
+		p = malloc(size);
+	if (p == NULL) {
+		if (flags & M_NOWAIT)
+			return NULL;
+		fail("out of memory");
+	}
+	if (flags & M_ZERO)
+		memset(p, 0, size);
+	return p;
+}
+
+void
+sim_free(void *p)
+{
+	free(p);
+}
+
+/*
+ * VM objects: a memfd each, so the kernel mapping of a page and any
+ * other mapping of it share the memory. Pages are always resident.
+ */
+
+struct vm_object {
+	int		refs;
+	int		fd;
+	vm_pindex_t	npages;
+	struct vm_page	*pages;
+};
+
+struct vm_page {
+	vm_object_t	object;
+	vm_pindex_t	pindex;
+};
+
+vm_object_t
+vm_pager_allocate(int type, void *handle, vm_ooffset_t size, vm_prot_t prot, vm_ooffset_t off, struct ucred *cred)
+{
+	vm_object_t obj = sim_malloc(sizeof(*obj), M_WAITOK | M_ZERO);
+	vm_pindex_t i;
+
+	obj->refs = 1;
+	obj->npages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+	obj->pages = sim_malloc(obj->npages * sizeof(*obj->pages), M_WAITOK | M_ZERO);
+	for (i = 0; i < obj->npages; ++i) {
+		obj->pages[i].object = obj;
+		obj->pages[i].pindex = i;
+	}
+	if ((obj->fd = memfd_create("vm_object", MFD_CLOEXEC)) < 0 ||
+	    ftruncate(obj->fd, obj->npages * PAGE_SIZE) != 0)
+		fail("vm object: %s", strerror(errno));
+	return obj;
+}
+
+void
+vm_object_reference(vm_object_t obj)
+{
+	__atomic_add_fetch(&obj->refs, 1, __ATOMIC_RELAXED);
+}
+
+void
+vm_object_deallocate(vm_object_t obj)
+{
+	if (__atomic_sub_fetch(&obj->refs, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+	close(obj->fd);
+	free(obj->pages);
+	free(obj);
+}
+
+// memfd pages start out zero, which is all VM_ALLOC_ZERO asks
+vm_page_t
+vm_page_grab(vm_object_t obj, vm_pindex_t pindex, int flags)
+{
+	if (pindex >= obj->npages)
+		fail("vm_page_grab: page %lu of %lu", pindex, obj->npages);
+	return &obj->pages[pindex];
+}
+
+vm_offset_t
+kva_alloc(vm_size_t size)
+{
+	void *va = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	return va == MAP_FAILED ? 0 : (vm_offset_t)va;
+}
+
+void
+kva_free(vm_offset_t va, vm_size_t size)
+{
+	munmap((void *)va, size);
+}
+
+void
+pmap_qenter(vm_offset_t va, vm_page_t *ma, int count)
+{
+	int i;
+
+	for (i = 0; i < count; ++i)
+		if (mmap((void *)(va + i * PAGE_SIZE), PAGE_SIZE, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_FIXED, ma[i]->object->fd, ma[i]->pindex * PAGE_SIZE) == MAP_FAILED)
+			fail("pmap_qenter: %s", strerror(errno));
+}
+
+void
+pmap_qremove(vm_offset_t va, int count)
+{
+	mmap((void *)va, count * PAGE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+}
+
+// "user" addresses are ordinary pointers in the harness
+int
+copyin(const void *uaddr, void *kaddr, size_t len)
+{
+	memcpy(kaddr, uaddr, len);
+	return 0;
+}
+
+int
+copyout(const void *kaddr, void *uaddr, size_t len)
+{
+	memcpy(uaddr, kaddr, len);
+	return 0;
+}
+
+int
+uiomove(void *cp, int n, struct uio *uio)
+{
+	n = MIN(n, uio->uio_resid);
+	memcpy(uio->uio_buf, cp, n);
+	uio->uio_buf = (char *)uio->uio_buf + n;
+	uio->uio_resid -= n;
+	return 0;
+}
+
+// the caller's terminal
+int
+uprintf(const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (sim_tty == NULL)
+		return 0;
+	va_start(ap, fmt);
+	n = vfprintf(sim_tty, fmt, ap);
+	va_end(ap);
+	return n;
+}
+
+int
+device_printf(device_t dev, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	// the console
+	n = fprintf(stderr, "tsg%d: ", device_get_unit(dev));
+	n += vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	return n;
+}
+
+/*
+ * locks
+ */
+
+void
+mtx_init(struct mtx *m, const char *name, const char *type, int opts)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+	pthread_mutex_init(&m->m, &attr);
+	pthread_mutexattr_destroy(&attr);
+	m->owned = false;
+	m->name = name;
+}
+
+void
+mtx_destroy(struct mtx *m)
+{
+	if (m->owned)
+		fail("%s destroyed while held", m->name);
+	pthread_mutex_destroy(&m->m);
+}
+
+void
+mtx_lock(struct mtx *m)
+{
+	if (pthread_mutex_lock(&m->m) != 0)
+		fail("%s: recursed on non-recursive lock", m->name);
+	m->owner = pthread_self();
+	m->owned = true;
+}
+
+int
+mtx_trylock(struct mtx *m)
+{
+	if (pthread_mutex_trylock(&m->m) != 0)
+		return 0;
+	m->owner = pthread_self();
+	m->owned = true;
+	return 1;
+}
+
+void
+mtx_unlock(struct mtx *m)
+{
+	m->owned = false;
+	if (pthread_mutex_unlock(&m->m) != 0)
+		fail("%s: unlock of unowned lock", m->name);
+}
+
+void
+_mtx_assert(struct mtx *m, const char *file, int line)
+{
+	if (!m->owned || !pthread_equal(m->owner, pthread_self()))
+		fail("%s not owned at %s:%d", m->name, file, line);
+}
+
+// One condition variable for every wait channel: wakeup() wakes all
+// sleepers, and those on other channels go back to sleep, as everything in
+// the driver that sleeps rechecks its condition in a loop.
+static pthread_mutex_t sleepq_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sleepq_cv = PTHREAD_COND_INITIALIZER;
+static uint64_t sleepq_gen;
+
+int
+msleep(void *chan, struct mtx *m, int pri, const char *wmesg, int timo)
+{
+	struct timespec ts;
+	uint64_t gen;
+	int error = 0;
+
+	if (timo > 0) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += timo / hz;
+		ts.tv_nsec += (long)(timo % hz) * (1000000000 / hz);
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+	}
+	pthread_mutex_lock(&sleepq_mtx);
+	mtx_unlock(m);
+	gen = sleepq_gen;
+	while (gen == sleepq_gen && error == 0) {
+		if (timo > 0)
+			error = pthread_cond_timedwait(&sleepq_cv, &sleepq_mtx, &ts);
+		else
+			pthread_cond_wait(&sleepq_cv, &sleepq_mtx);
+	}
+	pthread_mutex_unlock(&sleepq_mtx);
+	mtx_lock(m);
+	return error == ETIMEDOUT ? EWOULDBLOCK : 0;
+}
+
+void
+wakeup(void *chan)
+{
+	pthread_mutex_lock(&sleepq_mtx);
+	sleepq_gen++;
+	pthread_cond_broadcast(&sleepq_cv);
+	pthread_mutex_unlock(&sleepq_mtx);
+}
+
+/*
+ * callouts and timeout tasks; both are kept on lists, which sim_advance()
+ * runs through every tick. A callout's state is protected by its mutex,
+ * as in the kernel; the lists by sim_mtx.
+ */
+
+static pthread_mutex_t sim_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct callout *callouts;
+static struct timeout_task *timeout_tasks;
+
+void
+callout_init_mtx(struct callout *c, struct mtx *m, int flags)
+{
+	c->c_mtx = m;
+	c->c_func = NULL;
+	c->c_pending = false;
+	pthread_mutex_lock(&sim_mtx);
+	c->c_next = callouts;
+	callouts = c;
+	pthread_mutex_unlock(&sim_mtx);
+}
+
+int
+callout_reset(struct callout *c, int to_ticks, void (*func)(void *), void *arg)
+{
+	bool pending = c->c_pending;
+
+	_mtx_assert(c->c_mtx, __FILE__, __LINE__);
+	c->c_func = func;
+	c->c_arg = arg;
+	c->c_time = ticks + MAX(to_ticks, 1);
+	c->c_pending = true;
+	return pending;
+}
+
+int
+callout_schedule(struct callout *c, int to_ticks)
+{
+	return callout_reset(c, to_ticks, c->c_func, c->c_arg);
+}
+
+int
+callout_stop(struct callout *c)
+{
+	bool pending = c->c_pending;
+
+	_mtx_assert(c->c_mtx, __FILE__, __LINE__);
+	c->c_pending = false;
+	return pending;
+}
+
+// stop c and take it off the list, as its memory is about to go
+int
+callout_drain(struct callout *c)
+{
+	struct callout **cp;
+	bool pending;
+
+	mtx_lock(c->c_mtx);
+	pending = c->c_pending;
+	c->c_pending = false;
+	mtx_unlock(c->c_mtx);
+	pthread_mutex_lock(&sim_mtx);
+	for (cp = &callouts; *cp != NULL; cp = &(*cp)->c_next)
+		if (*cp == c) {
+			*cp = c->c_next;
+			break;
+		}
+	pthread_mutex_unlock(&sim_mtx);
+	return pending;
+}
+
+int
+taskqueue_enqueue_timeout(struct taskqueue *tq, struct timeout_task *t, int to_ticks)
+{
+	struct timeout_task *p;
+
+	pthread_mutex_lock(&sim_mtx);
+	for (p = timeout_tasks; p != NULL && p != t; p = p->t_next)
+		;
+	if (p == NULL) {
+		t->t_next = timeout_tasks;
+		timeout_tasks = t;
+	}
+	t->t_time = ticks + MAX(to_ticks, 1);
+	t->t_pending = true;
+	pthread_mutex_unlock(&sim_mtx);
+	return 0;
+}
+
+void
+taskqueue_drain_timeout(struct taskqueue *tq, struct timeout_task *t)
+{
+	struct timeout_task **tp;
+
+	pthread_mutex_lock(&sim_mtx);
+	t->t_pending = false;
+	for (tp = &timeout_tasks; *tp != NULL; tp = &(*tp)->t_next)
+		if (*tp == t) {
+			*tp = t->t_next;
+			break;
+		}
+	pthread_mutex_unlock(&sim_mtx);
+}
+
+// run the callouts and tasks due at ticks; each one found is run by itself,
+// as running it may change the lists
+static void
+run_due(void)
+{
+	struct callout *c;
+	struct timeout_task *t;
+	bool ran;
+
+	do {
+		ran = false;
+		pthread_mutex_lock(&sim_mtx);
+		for (c = callouts; c != NULL; c = c->c_next)
+			if (c->c_pending && ticks - c->c_time >= 0)
+				break;
+		pthread_mutex_unlock(&sim_mtx);
+		if (c != NULL) {
+			mtx_lock(c->c_mtx);
+			if (c->c_pending && ticks - c->c_time >= 0) {
+				c->c_pending = false;
+				(*c->c_func)(c->c_arg);
+			}
+			mtx_unlock(c->c_mtx);
+			ran = true;
+		}
+
+		pthread_mutex_lock(&sim_mtx);
+		for (t = timeout_tasks; t != NULL; t = t->t_next)
+			if (t->t_pending && ticks - t->t_time >= 0)
+				break;
+		if (t != NULL)
+			t->t_pending = false;
+		pthread_mutex_unlock(&sim_mtx);
+		if (t != NULL) {
+			(*t->t_func)(t->t_ctx, 1);
+			ran = true;
+		}
+	} while (ran);
+}
+
+void
+sim_advance(uint32_t ms)
+{
+	uint32_t i, n = (uint64_t)ms * hz / 1000;
+
+	for (i = 0; i < n; ++i) {
+		ticks++;
+		bar_advance(1000000000 / hz);
+		run_due();
+	}
+}
+
+/*
+ * PPS API: the capture is the system time at the interrupt
+ */
+
+void
+pps_capture(struct pps_state *pps)
+{
+	clock_gettime(CLOCK_REALTIME, &pps->capture);
+}
+
+void
+pps_event(struct pps_state *pps, int event)
+{
+	if ((pps->ppsparam.mode & event) == 0)
+		return;
+	pps->ppsinfo.assert_sequence++;
+	pps->ppsinfo.assert_timestamp = pps->capture;
+}
+
+int
+pps_ioctl(u_long cmd, caddr_t data, struct pps_state *pps)
+{
+	return ENOTTY;
+}
+
+/*
+ * character devices; the file being operated on is per thread, for
+ * devfs_get_cdevpriv()
+ */
+
+struct sim_file {
+	struct cdev	*cdev;
+	void		*priv;
+	void		(*dtor)(void *);
+};
+
+static struct cdev *cdevs;
+static __thread struct sim_file *curfile;
+
+void
+make_dev_args_init(struct make_dev_args *args)
+{
+	memset(args, 0, sizeof(*args));
+}
+
+int
+make_dev_s(struct make_dev_args *args, struct cdev **cdev, const char *fmt, ...)
+{
+	struct cdev *dev;
+	va_list ap;
+
+	dev = sim_malloc(sizeof(*dev), M_WAITOK | M_ZERO);
+	dev->si_devsw = args->mda_devsw;
+	dev->si_drv1 = args->mda_si_drv1;
+	dev->si_drv2 = args->mda_si_drv2;
+	va_start(ap, fmt);
+	vsnprintf(dev->si_name, sizeof(dev->si_name), fmt, ap);
+	va_end(ap);
+	pthread_mutex_lock(&sim_mtx);
+	dev->si_next = cdevs;
+	cdevs = dev;
+	pthread_mutex_unlock(&sim_mtx);
+	*cdev = dev;
+	return 0;
+}
+
+void
+destroy_dev(struct cdev *dev)
+{
+	struct cdev **dp;
+
+	pthread_mutex_lock(&sim_mtx);
+	for (dp = &cdevs; *dp != NULL; dp = &(*dp)->si_next)
+		if (*dp == dev) {
+			*dp = dev->si_next;
+			break;
+		}
+	pthread_mutex_unlock(&sim_mtx);
+	free(dev);
+}
+
+int
+devfs_set_cdevpriv(void *priv, void (*dtor)(void *))
+{
+	if (curfile->priv != NULL)
+		return EBUSY;
+	curfile->priv = priv;
+	curfile->dtor = dtor;
+	return 0;
+}
+
+int
+devfs_get_cdevpriv(void **priv)
+{
+	*priv = curfile->priv;
+	return *priv == NULL ? EBADF : 0;
+}
+
+struct sim_file *
+sim_open(const char *name)
+{
+	struct sim_file *fp;
+	struct cdev *dev;
+	int error;
+
+	pthread_mutex_lock(&sim_mtx);
+	for (dev = cdevs; dev != NULL; dev = dev->si_next)
+		if (strcmp(dev->si_name, name) == 0)
+			break;
+	pthread_mutex_unlock(&sim_mtx);
+	if (dev == NULL) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	fp = sim_malloc(sizeof(*fp), M_WAITOK | M_ZERO);
+	fp->cdev = dev;
+	curfile = fp;
+	error = (*dev->si_devsw->d_open)(dev, O_RDWR, 0, NULL);
+	curfile = NULL;
+	if (error != 0) {
+		free(fp);
+		errno = error;
+		return NULL;
+	}
+	return fp;
+}
+
+void
+sim_close(struct sim_file *fp)
+{
+	curfile = fp;
+	(*fp->cdev->si_devsw->d_close)(fp->cdev, O_RDWR, 0, NULL);
+	curfile = NULL;
+	if (fp->dtor != NULL)
+		(*fp->dtor)(fp->priv);
+	free(fp);
+}
+
+// copy the argument in and out around the handler, as ioctl(2) does
+int
+sim_ioctl(struct sim_file *fp, unsigned long cmd, void *arg)
+{
+	uint8_t buf[IOCPARM_MAX] __attribute__((aligned(16)));
+	size_t len = IOCPARM_LEN(cmd);
+	int error;
+
+	if (cmd & IOC_IN)
+		memcpy(buf, arg, len);
+	else
+		memset(buf, 0, len);
+	curfile = fp;
+	error = (*fp->cdev->si_devsw->d_ioctl)(fp->cdev, cmd, (caddr_t)buf, O_RDWR, NULL);
+	curfile = NULL;
+	if (error == 0 && (cmd & IOC_OUT))
+		memcpy(arg, buf, len);
+	return error;
+}
+
+ssize_t
+sim_read(struct sim_file *fp, void *buf, size_t len, int nonblock)
+{
+	struct uio uio = { buf, len };
+	int error;
+
+	curfile = fp;
+	error = (*fp->cdev->si_devsw->d_read)(fp->cdev, &uio, nonblock ? O_NONBLOCK : 0);
+	curfile = NULL;
+	if (error != 0) {
+		errno = error;
+		return -1;
+	}
+	return len - uio.uio_resid;
+}
+
+// Map the device like mmap(2) with MAP_SHARED. The mapping keeps the
+// object's memory, so the reference d_mmap_single took is dropped here.
+void *
+sim_mmap(struct sim_file *fp, size_t len, int prot)
+{
+	vm_ooffset_t off = 0;
+	vm_object_t obj;
+	void *p;
+	int error;
+
+	if (fp->cdev->si_devsw->d_mmap_single == NULL) {
+		errno = ENODEV;
+		return NULL;
+	}
+	curfile = fp;
+	error = (*fp->cdev->si_devsw->d_mmap_single)(fp->cdev, &off, len, &obj, prot);
+	curfile = NULL;
+	if (error != 0) {
+		errno = error;
+		return NULL;
+	}
+	p = mmap(NULL, len, prot, MAP_SHARED, obj->fd, off);
+	vm_object_deallocate(obj);
+	return p == MAP_FAILED ? NULL : p;
+}
+
+/*
+ * sysctl: a tree of named nodes, u64 leaves and handlers
+ */
+
+struct sysctl_oid {
+	struct sysctl_oid	*next;		// sibling
+	struct sysctl_oid_list	children;
+	const char		*name;
+	uint64_t		*u64;
+	int			(*handler)(SYSCTL_HANDLER_ARGS);
+	void			*arg1;
+	intmax_t		arg2;
+};
+
+static struct sysctl_oid *
+sysctl_add(struct sysctl_oid_list *parent, const char *name)
+{
+	struct sysctl_oid *oid, **op;
+
+	oid = sim_malloc(sizeof(*oid), M_WAITOK | M_ZERO);
+	oid->name = strdup(name);
+	// keep the order they were added in
+	for (op = &parent->first; *op != NULL; op = &(*op)->next)
+		;
+	*op = oid;
+	return oid;
+}
+
+static void
+sysctl_free(struct sysctl_oid_list *list)
+{
+	struct sysctl_oid *oid, *next;
+
+	for (oid = list->first; oid != NULL; oid = next) {
+		next = oid->next;
+		sysctl_free(&oid->children);
+		free((void *)oid->name);
+		free(oid);
+	}
+	list->first = NULL;
+}
+
+struct sysctl_oid_list *
+SYSCTL_CHILDREN(struct sysctl_oid *oid)
+{
+	return &oid->children;
+}
+
+struct sysctl_oid *
+SYSCTL_ADD_NODE(struct sysctl_ctx_list *ctx, struct sysctl_oid_list *parent, int nbr,
+    const char *name, int access, int (*handler)(SYSCTL_HANDLER_ARGS), const char *descr)
+{
+	return sysctl_add(parent, name);
+}
+
+struct sysctl_oid *
+SYSCTL_ADD_U64(struct sysctl_ctx_list *ctx, struct sysctl_oid_list *parent, int nbr,
+    const char *name, int access, uint64_t *ptr, uint64_t val, const char *descr)
+{
+	struct sysctl_oid *oid = sysctl_add(parent, name);
+
+	oid->u64 = ptr;
+	return oid;
+}
+
+struct sysctl_oid *
+SYSCTL_ADD_PROC(struct sysctl_ctx_list *ctx, struct sysctl_oid_list *parent, int nbr,
+    const char *name, int access, void *arg1, intmax_t arg2,
+    int (*handler)(SYSCTL_HANDLER_ARGS), const char *fmt, const char *descr)
+{
+	struct sysctl_oid *oid = sysctl_add(parent, name);
+
+	oid->handler = handler;
+	oid->arg1 = arg1;
+	oid->arg2 = arg2;
+	return oid;
+}
+
+static int
+sysctl_out(struct sysctl_req *req, const void *p, size_t len)
+{
+	if (req->oldlen + len + 1 > req->oldsize) {
+		req->oldsize = MAX(req->oldsize * 2, req->oldlen + len + 1);
+		req->oldptr = realloc(req->oldptr, req->oldsize);
+		if (req->oldptr == NULL)
+			fail("out of memory");
+	}
+	memcpy(req->oldptr + req->oldlen, p, len);
+	req->oldlen += len;
+	req->oldptr[req->oldlen] = '\0';
+	return 0;
+}
+
+int
+sysctl_handle_int(SYSCTL_HANDLER_ARGS)
+{
+	char buf[16];
+	int *p = arg1;
+
+	snprintf(buf, sizeof(buf), "%d", *p);
+	sysctl_out(req, buf, strlen(buf));
+	if (req->newptr != NULL)
+		*p = *(int *)req->newptr;
+	return 0;
+}
+
+struct sbuf {
+	struct sysctl_req	*req;
+};
+
+struct sbuf *
+sbuf_new_for_sysctl(struct sbuf *s, char *buf, int length, struct sysctl_req *req)
+{
+	s = sim_malloc(sizeof(*s), M_WAITOK);
+	s->req = req;
+	return s;
+}
+
+int
+sbuf_printf(struct sbuf *s, const char *fmt, ...)
+{
+	char buf[256];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	return sysctl_out(s->req, buf, MIN(n, sizeof(buf) - 1));
+}
+
+int
+sbuf_finish(struct sbuf *s)
+{
+	return 0;
+}
+
+void
+sbuf_delete(struct sbuf *s)
+{
+	free(s);
+}
+
+/*
+ * the device: one simulated card on a simulated PCI bus
+ */
+
+extern driver_t *sim_driver;
+extern modeventhand_t sim_modevent;
+
+struct device {
+	void			*softc;
+	int			unit;
+	uint16_t		subdevice;
+	const char		*desc;
+	struct sysctl_oid_list	sysctl_root;	// holds dev.tsg.N
+	struct sysctl_oid	*sysctl_tree;
+	driver_filter_t		*filter;
+	driver_intr_t		*ithread;
+	void			*intr_arg;
+};
+
+static struct device sim_dev;
+
+void *
+device_get_softc(device_t dev)
+{
+	return dev->softc;
+}
+
+int
+device_get_unit(device_t dev)
+{
+	return dev->unit;
+}
+
+void
+device_set_desc(device_t dev, const char *desc)
+{
+	dev->desc = desc;
+}
+
+struct sysctl_ctx_list *
+device_get_sysctl_ctx(device_t dev)
+{
+	return NULL;
+}
+
+struct sysctl_oid *
+device_get_sysctl_tree(device_t dev)
+{
+	return dev->sysctl_tree;
+}
+
+uint16_t pci_get_vendor(device_t dev) { return 0x10b5; }
+uint16_t pci_get_device(device_t dev) { return 0x9050; }
+uint16_t pci_get_subvendor(device_t dev) { return 0x12da; }
+uint16_t pci_get_subdevice(device_t dev) { return dev->subdevice; }
+
+struct resource *
+bus_alloc_resource_any(device_t dev, int type, int *rid, u_int flags)
+{
+	// there is nothing behind the interrupt resource; the handlers are
+	// kept in the device
+	if (type == SYS_RES_IRQ)
+		return (struct resource *)dev;
+	if (type == SYS_RES_MEMORY)
+		return bar_alloc(*rid == PCIR_BAR(0) ? 0 : *rid == PCIR_BAR(2) ? 2 : -1);
+	return NULL;
+}
+
+int
+bus_release_resource(device_t dev, int type, int rid, struct resource *r)
+{
+	if (type == SYS_RES_MEMORY)
+		bar_release(r);
+	return 0;
+}
+
+int
+bus_setup_intr(device_t dev, struct resource *r, int flags, driver_filter_t *filter,
+    driver_intr_t *ithread, void *arg, void **cookiep)
+{
+	dev->filter = filter;
+	dev->ithread = ithread;
+	dev->intr_arg = arg;
+	*cookiep = dev;
+	return 0;
+}
+
+int
+bus_teardown_intr(device_t dev, struct resource *r, void *cookie)
+{
+	dev->filter = NULL;
+	dev->ithread = NULL;
+	return 0;
+}
+
+static void *
+driver_method(const char *name)
+{
+	device_method_t *m;
+
+	for (m = sim_driver->methods; m->name != NULL; ++m)
+		if (strcmp(m->name, name) == 0)
+			return m->func;
+	fail("driver has no %s", name);
+	return NULL;
+}
+
+const char *
+sim_attach(uint16_t model)
+{
+	int (*probe)(device_t) = driver_method("device_probe");
+	int (*attach)(device_t) = driver_method("device_attach");
+	struct sysctl_oid *dev, *driver;
+	char unit[8];
+	int error;
+
+	memset(&sim_dev, 0, sizeof(sim_dev));
+	sim_dev.subdevice = model;
+	bar_init(model);
+	if ((error = (*sim_modevent)(NULL, MOD_LOAD, NULL)) != 0 ||
+	    (error = (*probe)(&sim_dev)) > 0) {
+		errno = error;
+		return NULL;
+	}
+
+	dev = sysctl_add(&sim_dev.sysctl_root, "dev");
+	driver = sysctl_add(SYSCTL_CHILDREN(dev), sim_driver->name);
+	snprintf(unit, sizeof(unit), "%d", sim_dev.unit);
+	sim_dev.sysctl_tree = sysctl_add(SYSCTL_CHILDREN(driver), unit);
+
+	sim_dev.softc = sim_malloc(sim_driver->size, M_WAITOK | M_ZERO);
+	if ((error = (*attach)(&sim_dev)) != 0) {
+		free(sim_dev.softc);
+		sysctl_free(&sim_dev.sysctl_root);
+		errno = error;
+		return NULL;
+	}
+	return sim_dev.desc;
+}
+
+void
+sim_detach(void)
+{
+	int (*detach)(device_t) = driver_method("device_detach");
+
+	(*detach)(&sim_dev);
+	(*sim_modevent)(NULL, MOD_UNLOAD, NULL);
+	free(sim_dev.softc);
+	sysctl_free(&sim_dev.sysctl_root);
+}
+
+// Raise the interrupt line and run the handlers as the kernel would,
+// timing each. The ithread runs in the caller's thread, straight after the
+// filter.
+int
+sim_interrupt(struct sim_intr_time *t)
+{
+	struct timespec t0, t1, t2;
+	int rv;
+
+	if (sim_dev.filter == NULL)
+		return FILTER_STRAY;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	rv = (*sim_dev.filter)(sim_dev.intr_arg);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	if (rv & FILTER_SCHEDULE_THREAD)
+		(*sim_dev.ithread)(sim_dev.intr_arg);
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+
+	t->filter_nsec += (t1.tv_sec - t0.tv_sec) * 1000000000LL + t1.tv_nsec - t0.tv_nsec;
+	t->filter_calls++;
+	if (rv & FILTER_SCHEDULE_THREAD) {
+		t->ithread_nsec += (t2.tv_sec - t1.tv_sec) * 1000000000LL + t2.tv_nsec - t1.tv_nsec;
+		t->ithread_calls++;
+	}
+	return rv;
+}
+
+static struct sysctl_oid *
+sysctl_find(const char *name)
+{
+	struct sysctl_oid_list *list = &sim_dev.sysctl_root;
+	struct sysctl_oid *oid = NULL;
+	const char *p = name;
+	size_t len;
+
+	while (*p != '\0') {
+		len = strcspn(p, ".");
+		for (oid = list->first; oid != NULL; oid = oid->next)
+			if (strlen(oid->name) == len && strncmp(oid->name, p, len) == 0)
+				break;
+		if (oid == NULL)
+			return NULL;
+		list = &oid->children;
+		p += len;
+		if (*p == '.')
+			p++;
+	}
+	return oid;
+}
+
+int
+sim_sysctl_u64(const char *name, uint64_t *val)
+{
+	struct sysctl_oid *oid = sysctl_find(name);
+
+	if (oid == NULL || oid->u64 == NULL)
+		return ENOENT;
+	*val = *oid->u64;
+	return 0;
+}
+
+const char *
+sim_sysctl_child(const char *name, int i)
+{
+	struct sysctl_oid *oid = sysctl_find(name);
+
+	if (oid == NULL)
+		return NULL;
+	for (oid = oid->children.first; oid != NULL && i > 0; oid = oid->next)
+		--i;
+	return oid == NULL ? NULL : oid->name;
+}
+
+int
+sim_sysctl_set_int(const char *name, int val)
+{
+	struct sysctl_oid *oid = sysctl_find(name);
+	struct sysctl_req req = { &val, sizeof(val) };
+	int error;
+
+	if (oid == NULL || oid->handler == NULL)
+		return ENOENT;
+	error = (*oid->handler)(oid, oid->arg1, oid->arg2, &req);
+	free(req.oldptr);
+	return error;
+}
+
+static void
+sysctl_print(FILE *fp, struct sysctl_oid *oid, char *name, size_t len)
+{
+	struct sysctl_req req = { NULL };
+	size_t n = strlen(name);
+
+	snprintf(name + n, len - n, "%s%s", n > 0 ? "." : "", oid->name);
+	if (oid->u64 != NULL)
+		fprintf(fp, "%s: %ju\n", name, (uintmax_t)*oid->u64);
+	else if (oid->handler != NULL) {
+		(*oid->handler)(oid, oid->arg1, oid->arg2, &req);
+		fprintf(fp, "%s: %s\n", name, req.oldptr != NULL ? req.oldptr : "");
+		free(req.oldptr);
+	}
+	for (oid = oid->children.first; oid != NULL; oid = oid->next)
+		sysctl_print(fp, oid, name, len);
+	name[n] = '\0';
+}
+
+void
+sim_sysctl_dump(FILE *fp, const char *prefix)
+{
+	struct sysctl_oid *oid = sysctl_find(prefix);
+	char name[256];
+	const char *dot;
+
+	if (oid == NULL)
+		return;
+	dot = strrchr(prefix, '.');
+	snprintf(name, sizeof(name), "%.*s", dot == NULL ? 0 : (int)(dot - prefix), prefix);
+	sysctl_print(fp, oid, name, sizeof(name));
+}
@@ -0,0 +1,430 @@
+/*
+ * kern.h -- the part of the FreeBSD kernel interface tsg.c uses, for Linux
+ * userland
+ *
+ * tsg.c includes this instead of the kernel headers when built with
+ * -DTSG_SIM. Locks are pthread mutexes (spin mutexes too), msleep() and
+ * wakeup() share one condition variable, and callouts and timeout tasks
+ * run on virtual ticks, from sim_advance(). Register access goes to the
+ * simulated BARs in bar.c. Everything here is implemented in kern.c.
+ */
+
+#ifndef _TSGSIM_KERN_H
+#define	_TSGSIM_KERN_H
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ioccom.h"
+
+// the driver and its headers see a kernel build from here on
+#define	_KERNEL
+
+#ifndef nitems
+#define	nitems(x)	(sizeof(x) / sizeof((x)[0]))
+#endif
+#define	CTASSERT(x)	_Static_assert(x, #x)
+#define	__unused	__attribute__((unused))
+
+#define	PAGE_SIZE	4096
+
+typedef char			*caddr_t;
+typedef u_long			bus_size_t;
+typedef int64_t			vm_ooffset_t;
+typedef size_t			vm_size_t;
+typedef uintptr_t		vm_offset_t;
+typedef u_long			vm_pindex_t;
+typedef uint8_t			vm_prot_t;
+typedef int64_t			sbintime_t;
+
+struct thread;
+struct cdev;
+struct module;
+typedef struct module		*module_t;
+typedef struct device		*device_t;
+typedef void			*devclass_t;
+
+// byte order; the registers are little endian, and so is the host
+static __inline uint16_t le16dec(const void *p) { const uint8_t *b = p; return b[0] | b[1] << 8; }
+static __inline uint32_t le32dec(const void *p) { const uint8_t *b = p; return le16dec(b) | (uint32_t)le16dec(b + 2) << 16; }
+static __inline uint64_t le64dec(const void *p) { const uint8_t *b = p; return le32dec(b) | (uint64_t)le32dec(b + 4) << 32; }
+static __inline void le16enc(void *p, uint16_t v) { uint8_t *b = p; b[0] = v; b[1] = v >> 8; }
+static __inline void le32enc(void *p, uint32_t v) { uint8_t *b = p; le16enc(b, v); le16enc(b + 2, v >> 16); }
+static __inline void le64enc(void *p, uint64_t v) { uint8_t *b = p; le32enc(b, v); le32enc(b + 4, v >> 32); }
+
+static __inline int flsll(long long v) { return v == 0 ? 0 : 64 - __builtin_clzll(v); }
+
+// atomics
+#define	atomic_add_64(p, v)		__atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#define	atomic_store_rel_32(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define	atomic_thread_fence_rel()	__atomic_thread_fence(__ATOMIC_RELEASE)
+
+// time
+extern int ticks;				// virtual, advanced by sim_advance()
+#define	hz		1000
+#define	SBT_1S		((sbintime_t)1 << 32)
+#define	sbttons(sbt)	((int64_t)(((uint64_t)(sbt) * 1000000000) >> 32))
+
+sbintime_t	sbinuptime(void);
+void		nanotime(struct timespec *);
+uint64_t	get_cyclecount(void);
+int		tvtohz(struct timeval *);
+
+// memory
+#define	M_DEVBUF	0
+#define	M_WAITOK	0x0002
+#define	M_NOWAIT	0x0001
+#define	M_ZERO		0x0100
+
+void	*sim_malloc(size_t, int);
+void	sim_free(void *);
+#define	malloc(size, type, flags)	sim_malloc((size), (flags))
+#define	free(addr, type)		sim_free(addr)
+
+int	copyin(const void *, void *, size_t);
+int	copyout(const void *, void *, size_t);
+
+struct uio {
+	void	*uio_buf;			// the caller's buffer
+	ssize_t	uio_resid;
+};
+
+int	uiomove(void *, int, struct uio *);
+
+int	uprintf(const char *, ...) __attribute__((format(printf, 1, 2)));
+int	device_printf(device_t, const char *, ...) __attribute__((format(printf, 2, 3)));
+
+// VM objects are memfds, and the kernel maps pages of them with
+// pmap_qenter() into address space that kva_alloc() reserved
+#define	OBJT_PHYS	1
+#define	VM_PROT_READ	0x01
+#define	VM_ALLOC_WIRED	0x0020
+#define	VM_ALLOC_ZERO	0x0040
+#define	VM_ALLOC_NOBUSY	0x0200
+
+typedef struct vm_object	*vm_object_t;
+typedef struct vm_page		*vm_page_t;
+struct ucred;
+
+vm_object_t	vm_pager_allocate(int, void *, vm_ooffset_t, vm_prot_t, vm_ooffset_t, struct ucred *);
+void		vm_object_reference(vm_object_t);
+void		vm_object_deallocate(vm_object_t);
+vm_page_t	vm_page_grab(vm_object_t, vm_pindex_t, int);
+#define	VM_OBJECT_WLOCK(obj)		((void)(obj))
+#define	VM_OBJECT_WUNLOCK(obj)		((void)(obj))
+#define	vm_page_valid(m)		((void)(m))
+#define	vm_page_xunbusy(m)		((void)(m))
+#define	vm_page_unwire_noq(m)		((void)(m))
+vm_offset_t	kva_alloc(vm_size_t);
+void		kva_free(vm_offset_t, vm_size_t);
+void		pmap_qenter(vm_offset_t, vm_page_t *, int);
+void		pmap_qremove(vm_offset_t, int);
+
+// locks; mtx_assert() and sx_assert() check the owner
+#define	MTX_DEF		0x0000
+#define	MTX_SPIN	0x0001
+#define	MA_OWNED	0x04
+#define	SA_XLOCKED	0x04
+
+struct mtx {
+	pthread_mutex_t	m;
+	pthread_t	owner;
+	bool		owned;
+	const char	*name;
+};
+
+struct sx {
+	struct mtx	m;
+};
+
+void	mtx_init(struct mtx *, const char *, const char *, int);
+void	mtx_destroy(struct mtx *);
+void	mtx_lock(struct mtx *);
+int	mtx_trylock(struct mtx *);
+void	mtx_unlock(struct mtx *);
+void	_mtx_assert(struct mtx *, const char *, int);
+#define	mtx_lock_spin		mtx_lock
+#define	mtx_trylock_spin	mtx_trylock
+#define	mtx_unlock_spin		mtx_unlock
+#define	mtx_assert(m, what)	_mtx_assert((m), __FILE__, __LINE__)
+
+#define	sx_init(sx, name)	mtx_init(&(sx)->m, (name), NULL, MTX_DEF)
+#define	sx_destroy(sx)		mtx_destroy(&(sx)->m)
+#define	sx_xlock(sx)		mtx_lock(&(sx)->m)
+#define	sx_try_xlock(sx)	mtx_trylock(&(sx)->m)
+#define	sx_xunlock(sx)		mtx_unlock(&(sx)->m)
+#define	sx_assert(sx, what)	_mtx_assert(&(sx)->m, __FILE__, __LINE__)
+
+#define	PCATCH		0x100
+int	msleep(void *, struct mtx *, int, const char *, int);
+#define	msleep_spin(chan, m, wmesg, timo)	msleep((chan), (m), 0, (wmesg), (timo))
+void	wakeup(void *);
+
+// callouts and timeout tasks, run by sim_advance()
+struct callout {
+	struct callout	*c_next;
+	struct mtx	*c_mtx;
+	void		(*c_func)(void *);
+	void		*c_arg;
+	int		c_time;			// ticks when due
+	bool		c_pending;
+};
+
+void	callout_init_mtx(struct callout *, struct mtx *, int);
+int	callout_reset(struct callout *, int, void (*)(void *), void *);
+int	callout_schedule(struct callout *, int);
+int	callout_stop(struct callout *);
+int	callout_drain(struct callout *);
+
+struct taskqueue;
+extern struct taskqueue *taskqueue_thread;
+
+struct timeout_task {
+	struct timeout_task *t_next;
+	void		(*t_func)(void *, int);
+	void		*t_ctx;
+	int		t_time;
+	bool		t_pending;
+};
+
+#define	TIMEOUT_TASK_INIT(tq, t, pri, func, ctx) do {			\
+	(t)->t_func = (func);						\
+	(t)->t_ctx = (ctx);						\
+	(t)->t_pending = false;						\
+} while (0)
+int	taskqueue_enqueue_timeout(struct taskqueue *, struct timeout_task *, int);
+void	taskqueue_drain_timeout(struct taskqueue *, struct timeout_task *);
+
+// poll(2) and kqueue(2); nobody waits on them in the simulator
+#define	EVFILT_READ	(-1)
+#define	EV_EOF		0x8000
+
+struct knote;
+
+struct filterops {
+	int	f_isfd;
+	int	(*f_attach)(struct knote *);
+	void	(*f_detach)(struct knote *);
+	int	(*f_event)(struct knote *, long);
+};
+
+struct knote {
+	struct filterops *kn_fop;
+	void		*kn_hook;
+	int64_t		kn_data;
+	int		kn_filter;
+	u_short		kn_flags;
+};
+
+struct knlist {
+	struct mtx	*kl_mtx;
+};
+
+struct selinfo {
+	struct knlist	si_note;
+};
+
+#define	knlist_init_mtx(kl, m)	((kl)->kl_mtx = (m))
+#define	knlist_add(kl, kn, l)	((void)(kl), (void)(kn))
+#define	knlist_remove(kl, kn, l) ((void)(kl), (void)(kn))
+#define	knlist_clear(kl, l)	((void)(kl))
+#define	knlist_destroy(kl)	((void)(kl))
+#define	KNOTE_LOCKED(kl, h)	((void)(kl))
+#define	selrecord(td, sip)	((void)(sip))
+#define	selwakeup(sip)		((void)(sip))
+#define	seldrain(sip)		((void)(sip))
+
+// RFC 2783 PPS API, just the assert capture the driver uses
+#define	PPS_ABI_VERSION		1
+#define	PPS_CAPTUREASSERT	0x01
+#define	PPS_TSFMT_TSPEC		0x1000
+
+struct pps_state {
+	struct {
+		int		mode;
+	} ppsparam;
+	struct {
+		u_int		assert_sequence;
+		struct timespec	assert_timestamp;
+	} ppsinfo;
+	int		ppscap;
+	int		driver_abi;
+	struct mtx	*driver_mtx;
+	struct timespec	capture;		// taken by pps_capture()
+};
+
+#define	pps_init_abi(pps)	((void)(pps))
+void	pps_capture(struct pps_state *);
+void	pps_event(struct pps_state *, int);
+int	pps_ioctl(u_long, caddr_t, struct pps_state *);
+
+// character devices
+#define	D_VERSION	0x17122009
+#define	UID_ROOT	0
+#define	GID_WHEEL	0
+
+typedef int d_open_t(struct cdev *, int, int, struct thread *);
+typedef int d_close_t(struct cdev *, int, int, struct thread *);
+typedef int d_read_t(struct cdev *, struct uio *, int);
+typedef int d_ioctl_t(struct cdev *, u_long, caddr_t, int, struct thread *);
+typedef int d_poll_t(struct cdev *, int, struct thread *);
+typedef int d_kqfilter_t(struct cdev *, struct knote *);
+typedef int d_mmap_single_t(struct cdev *, vm_ooffset_t *, vm_size_t, struct vm_object **, int);
+
+struct cdevsw {
+	int		d_version;
+	d_open_t	*d_open;
+	d_close_t	*d_close;
+	d_read_t	*d_read;
+	d_ioctl_t	*d_ioctl;
+	d_mmap_single_t	*d_mmap_single;
+	d_poll_t	*d_poll;
+	d_kqfilter_t	*d_kqfilter;
+	const char	*d_name;
+};
+
+struct cdev {
+	struct cdev	*si_next;
+	struct cdevsw	*si_devsw;
+	void		*si_drv1;
+	void		*si_drv2;
+	char		si_name[32];
+};
+
+struct make_dev_args {
+	struct cdevsw	*mda_devsw;
+	uid_t		mda_uid;
+	gid_t		mda_gid;
+	int		mda_mode;
+	int		mda_unit;
+	void		*mda_si_drv1;
+	void		*mda_si_drv2;
+};
+
+void	make_dev_args_init(struct make_dev_args *);
+int	make_dev_s(struct make_dev_args *, struct cdev **, const char *, ...) __attribute__((format(printf, 3, 4)));
+void	destroy_dev(struct cdev *);
+int	devfs_set_cdevpriv(void *, void (*)(void *));
+int	devfs_get_cdevpriv(void **);
+
+// sysctl; kern.c keeps the tree so the harness can read it back
+struct sysctl_oid;
+struct sysctl_ctx_list;
+
+struct sysctl_oid_list {
+	struct sysctl_oid *first;
+};
+
+struct sysctl_req {
+	void		*newptr;		// value being set, or NULL
+	size_t		newlen;
+	char		*oldptr;		// value read back
+	size_t		oldlen;
+	size_t		oldsize;
+};
+
+#define	OID_AUTO	(-1)
+#define	CTLFLAG_RD	0x80000000
+#define	CTLFLAG_WR	0x40000000
+#define	CTLFLAG_RW	(CTLFLAG_RD|CTLFLAG_WR)
+#define	CTLFLAG_MPSAFE	0x00040000
+#define	CTLTYPE_INT	2
+#define	CTLTYPE_STRING	3
+
+#define	SYSCTL_HANDLER_ARGS	struct sysctl_oid *oidp, void *arg1, intmax_t arg2, struct sysctl_req *req
+
+struct sysctl_oid_list *SYSCTL_CHILDREN(struct sysctl_oid *);
+struct sysctl_oid *SYSCTL_ADD_NODE(struct sysctl_ctx_list *, struct sysctl_oid_list *, int, const char *, int, int (*)(SYSCTL_HANDLER_ARGS), const char *);
+struct sysctl_oid *SYSCTL_ADD_U64(struct sysctl_ctx_list *, struct sysctl_oid_list *, int, const char *, int, uint64_t *, uint64_t, const char *);
+struct sysctl_oid *SYSCTL_ADD_PROC(struct sysctl_ctx_list *, struct sysctl_oid_list *, int, const char *, int, void *, intmax_t, int (*)(SYSCTL_HANDLER_ARGS), const char *, const char *);
+int	sysctl_handle_int(SYSCTL_HANDLER_ARGS);
+
+struct sbuf;
+struct sbuf *sbuf_new_for_sysctl(struct sbuf *, char *, int, struct sysctl_req *);
+int	sbuf_printf(struct sbuf *, const char *, ...) __attribute__((format(printf, 2, 3)));
+int	sbuf_finish(struct sbuf *);
+void	sbuf_delete(struct sbuf *);
+
+// newbus and PCI
+#define	BUS_PROBE_DEFAULT	(-20)
+#define	BUS_PROBE_VENDOR	(-10)
+#define	SYS_RES_IRQ	1
+#define	SYS_RES_MEMORY	3
+#define	RF_ACTIVE	0x0002
+#define	RF_SHAREABLE	0x0004
+#define	INTR_TYPE_CLK	0x0080
+#define	INTR_MPSAFE	0x0200
+#define	FILTER_STRAY		0x01
+#define	FILTER_HANDLED		0x02
+#define	FILTER_SCHEDULE_THREAD	0x04
+#define	PCIR_BAR(x)	(0x10 + (x) * 4)
+
+typedef int driver_filter_t(void *);
+typedef void driver_intr_t(void *);
+
+struct resource;
+
+void	*device_get_softc(device_t);
+int	device_get_unit(device_t);
+void	device_set_desc(device_t, const char *);
+struct sysctl_ctx_list *device_get_sysctl_ctx(device_t);
+struct sysctl_oid *device_get_sysctl_tree(device_t);
+uint16_t	pci_get_vendor(device_t);
+uint16_t	pci_get_device(device_t);
+uint16_t	pci_get_subvendor(device_t);
+uint16_t	pci_get_subdevice(device_t);
+
+struct resource *bus_alloc_resource_any(device_t, int, int *, u_int);
+int	bus_release_resource(device_t, int, int, struct resource *);
+int	bus_setup_intr(device_t, struct resource *, int, driver_filter_t *, driver_intr_t *, void *, void **);
+int	bus_teardown_intr(device_t, struct resource *, void *);
+
+// the simulated BARs, in bar.c
+uint8_t	bus_read_1(struct resource *, bus_size_t);
+void	bus_write_1(struct resource *, bus_size_t, uint8_t);
+void	bus_read_region_1(struct resource *, bus_size_t, uint8_t *, bus_size_t);
+void	bus_write_region_1(struct resource *, bus_size_t, const uint8_t *, bus_size_t);
+void	bus_read_region_4(struct resource *, bus_size_t, uint32_t *, bus_size_t);
+void	bus_write_region_4(struct resource *, bus_size_t, const uint32_t *, bus_size_t);
+
+// module glue: the harness finds the driver and its event handler through these
+#define	MOD_LOAD	0
+#define	MOD_UNLOAD	1
+#define	MOD_SHUTDOWN	2
+
+typedef int (*modeventhand_t)(module_t, int, void *);
+
+typedef struct {
+	const char	*name;
+	void		*func;
+} device_method_t;
+
+#define	DEVMETHOD(name, func)	{ #name, (void *)(func) }
+
+typedef struct {
+	const char	*name;
+	device_method_t	*methods;
+	size_t		size;
+} driver_t;
+
+#define	DEV_MODULE(name, evh, arg)					\
+	modeventhand_t sim_modevent = (evh)
+#define	DRIVER_MODULE(name, busname, driver, devclass, evh, arg)	\
+	driver_t *sim_driver = &(driver);				\
+	devclass_t *sim_devclass = &(devclass)
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * sim.h -- driving the driver in userland
+ *
+ * sim_attach() probes and attaches the driver to a simulated card of the
+ * given model (TSG_MODEL_*), and returns its description. Its devices are
+ * then opened by name ("tsg0", "tsg0.pulse") and used with sim_ioctl(),
+ * sim_read() and sim_mmap(), which behave like ioctl(2), read(2) and
+ * mmap(2), except that sim_ioctl() returns an errno value.
+ *
+ * The card comes up as sim_card describes it, so the driver can be
+ * attached to a board that was left configured.
+ *
+ * Time on the board and in the driver (ticks) only moves in sim_advance(),
+ * which also runs the callouts that come due. sim_edge() makes events
+ * happen on the board, and runs the interrupt handlers if they raise the
+ * interrupt.
+ *
+ * Every register transaction is charged sim_latency, which is the cost of
+ * a PCI read or write through the bridge. With spin set the simulator
+ * busy-waits for it, so the driver's own timings include it.
+ */
+
+#ifndef _TSGSIM_SIM_H
+#define	_TSGSIM_SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+struct sim_file;
+
+struct sim_latency {
+	uint32_t	read_ns;
+	uint32_t	write_ns;
+	bool		spin;
+};
+
+extern struct sim_latency sim_latency;
+
+// what the card has programmed when sim_attach() finds it
+struct sim_card {
+	uint32_t	synth_freq;	// Hz, on the models with a synthesizer
+};
+
+extern struct sim_card sim_card;
+
+// where uprintf() goes; NULL to drop it
+extern FILE *sim_tty;
+
+// transactions on one BAR and their modelled cost
+struct sim_barstats {
+	uint64_t	reads;
+	uint64_t	writes;
+	uint64_t	nsec;
+};
+
+// the interrupt handlers as the simulator ran and timed them
+struct sim_intr_time {
+	uint64_t	filter_calls;
+	uint64_t	filter_nsec;
+	uint64_t	ithread_calls;
+	uint64_t	ithread_nsec;
+};
+
+const char	*sim_attach(uint16_t);
+void		sim_detach(void);
+
+struct sim_file	*sim_open(const char *);
+void		sim_close(struct sim_file *);
+int		sim_ioctl(struct sim_file *, unsigned long, void *);
+ssize_t		sim_read(struct sim_file *, void *, size_t, int);
+void		*sim_mmap(struct sim_file *, size_t, int);
+
+void		sim_advance(uint32_t);
+int		sim_edge(uint8_t, struct sim_intr_time *);
+int		sim_interrupt(struct sim_intr_time *);
+void		sim_bar_stats(int, struct sim_barstats *);
+
+// the driver's sysctl tree, by full name ("dev.tsg.0.bus.filter.reads")
+int		sim_sysctl_u64(const char *, uint64_t *);
+int		sim_sysctl_set_int(const char *, int);
+const char	*sim_sysctl_child(const char *, int);
+void		sim_sysctl_dump(FILE *, const char *);
+
+// between kern.c and bar.c
+struct resource;
+
+void		bar_init(uint16_t);
+struct resource	*bar_alloc(int);
+void		bar_release(struct resource *);
+void		bar_advance(uint32_t);
+
+#endif
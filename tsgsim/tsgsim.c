@@ -0,0 +1,250 @@
+/*
+ * tsgsim -- run the driver against a simulated card and report what each
+ * of its handlers costs on the bus
+ *
+ * The card is attached with its synthesizer already running at synth_hz,
+ * as a board left configured by an earlier load would be. Every getter is
+ * called count times, then a few setters, including clock
+ * presets, then the pulse output is run at 1kHz with its interrupt
+ * enabled for edges edges. The status watch callout runs throughout. The
+ * report has, for each interrupt handler, callout and ioctl, how many
+ * register reads and writes it made a call, what they cost at the
+ * configured latencies, and how long the handler took here, which
+ * includes that cost unless -N is given.
+ *
+ * The driver's own accounts (dev.tsg.0.bus and dev.tsg.0.ioctl) must add
+ * up to the transactions the simulated BAR saw; tsgsim exits 1 if not.
+ */
+
+#include <sys/param.h>
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ioccom.h"
+#include "tsg.h"
+#include "sim.h"
+
+#ifndef nitems
+#define	nitems(x)	(sizeof(x) / sizeof((x)[0]))
+#endif
+
+#define	EDGE_PULSE	0x04	// TSG_INTR_PULSE in tsg.c
+
+#define	GETTER(cmd)	{ cmd, #cmd }
+
+static struct {
+	unsigned long	cmd;
+	const char	*name;
+} getters[] = {
+	GETTER(TSG_GET_BOARD_MODEL),
+	GETTER(TSG_GET_BOARD_FIRMWARE),
+	GETTER(TSG_GET_BOARD_TEST_STATUS),
+	GETTER(TSG_GET_BOARD_J1),
+	GETTER(TSG_GET_BOARD_PIN6),
+	GETTER(TSG_GET_PULSE_FREQ),
+	GETTER(TSG_GET_GPS_ANTENNA_STATUS),
+	GETTER(TSG_GET_GPS_POSITION),
+	GETTER(TSG_GET_GPS_SIGNAL),
+	GETTER(TSG_GET_CLOCK_LOCK),
+	GETTER(TSG_GET_CLOCK_TIMECODE),
+	GETTER(TSG_GET_CLOCK_REF),
+	GETTER(TSG_GET_CLOCK_TIME),
+	GETTER(TSG_GET_CLOCK_TIME_CYCLES),
+	GETTER(TSG_GET_CLOCK_PRESET),
+	GETTER(TSG_GET_CLOCK_LEAP),
+	GETTER(TSG_GET_CLOCK_DAC),
+	GETTER(TSG_GET_CLOCK_DST),
+	GETTER(TSG_GET_CLOCK_STOP),
+	GETTER(TSG_GET_CLOCK_TZ_OFFSET),
+	GETTER(TSG_GET_CLOCK_PHASE_COMP),
+	GETTER(TSG_GET_TIMECODE_QUALITY),
+	GETTER(TSG_GET_USE_TIMECODE_QUALITY),
+	GETTER(TSG_GET_TIMECODE_AGC_DELAYS),
+	GETTER(TSG_GET_SYNTH_FREQ),
+	GETTER(TSG_GET_SYNTH_EDGE),
+	GETTER(TSG_GET_SYNTH_ENABLE),
+	GETTER(TSG_GET_COMPARE_TIME),
+	GETTER(TSG_GET_SCHEDULE),
+	GETTER(TSG_GET_INT_MASK),
+	GETTER(TSG_GET_STATUS),
+	GETTER(TSG_GET_WATCH_INTERVAL),
+	GETTER(TSG_GET_TELEMETRY),
+	GETTER(TSG_GET_BENCH),
+};
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+	    "usage: tsgsim [-dNv] [-m model] [-n count] [-e edges] [-s synth_hz] [-r read_ns] [-w write_ns]\n"
+	    "	-d		print the driver's sysctl tree afterwards\n"
+	    "	-N		don't spend the bus latency, only count it\n"
+	    "	-v		show the driver's messages to the caller (uprintf)\n"
+	    "	-m model	PCI subdevice id, 5900, 5901, 5907 or 5908 (default 5908)\n"
+	    "	-n count	calls of each ioctl (default 1000)\n"
+	    "	-e edges	pulse interrupts (default 1000)\n"
+	    "	-s synth_hz	synth frequency the card comes up with (default 1000)\n"
+	    "	-r, -w		nsec a register read or write costs (default 1000, 250)\n");
+	exit(2);
+}
+
+static uint64_t
+get(const char *fmt, const char *name, const char *leaf)
+{
+	char path[128];
+	uint64_t v = 0;
+
+	snprintf(path, sizeof(path), fmt, name, leaf);
+	sim_sysctl_u64(path, &v);
+	return v;
+}
+
+// one line of the report; nsec is the time measured here, or 0 if unknown
+static void
+report(const char *name, uint64_t calls, uint64_t reads, uint64_t writes, uint64_t errors, uint64_t nsec)
+{
+	double bus = (double)reads * sim_latency.read_ns + (double)writes * sim_latency.write_ns;
+
+	if (calls == 0)
+		return;
+	printf("%-28s %8ju %7.2f %7.2f %9.2f", name, (uintmax_t)calls,
+	    (double)reads / calls, (double)writes / calls, bus / calls / 1000);
+	if (nsec != 0)
+		printf(" %9.2f", (double)nsec / calls / 1000);
+	else
+		printf(" %9s", "-");
+	if (errors != 0)
+		printf("  %ju failed", (uintmax_t)errors);
+	printf("\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	uint8_t arg[IOCPARM_MAX] __attribute__((aligned(16)));
+	struct tsg_time t = { 2026, 290, 12, 0, 0, 0 };
+	struct sim_intr_time it = { 0 };
+	struct sim_barstats bar;
+	struct sim_file *fp;
+	const char *desc, *name;
+	uint64_t reads = 0, writes = 0;
+	uint16_t model = TSG_MODEL_GPS_PCI_2U;
+	uint8_t v;
+	int count = 1000, edges = 1000, dump = 0;
+	int c, i, j;
+
+	sim_card.synth_freq = 1000;
+	while ((c = getopt(argc, argv, "dNvm:n:e:s:r:w:")) != -1) {
+		switch (c) {
+		case 'd':
+			dump = 1;
+			break;
+		case 'N':
+			sim_latency.spin = false;
+			break;
+		case 'v':
+			sim_tty = stderr;
+			break;
+		case 'm':
+			model = strtoul(optarg, NULL, 16);
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'e':
+			edges = atoi(optarg);
+			break;
+		case 's':
+			sim_card.synth_freq = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			sim_latency.read_ns = atoi(optarg);
+			break;
+		case 'w':
+			sim_latency.write_ns = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	if ((desc = sim_attach(model)) == NULL)
+		errx(1, "attach %04x: %s", model, strerror(errno));
+	if ((fp = sim_open("tsg0")) == NULL)
+		err(1, "open tsg0");
+
+	// let the status watch take its first samples
+	sim_advance(1000);
+
+	for (i = 0; i < nitems(getters); ++i)
+		for (j = 0; j < count; ++j)
+			sim_ioctl(fp, getters[i].cmd, arg);
+
+	for (j = 0; j < count; ++j) {
+		v = TSG_PULSE_FREQ_1KHZ;
+		sim_ioctl(fp, TSG_SET_PULSE_FREQ, &v);
+		v = 0;
+		sim_ioctl(fp, TSG_SET_INT_MASK, &v);
+	}
+
+	// the board loads a preset at once, so the next poll finishes it
+	for (j = 0; j < MIN(count, 100); ++j) {
+		if ((c = sim_ioctl(fp, TSG_SET_CLOCK_TIME, &t)) != 0)
+			errx(1, "TSG_SET_CLOCK_TIME: %s", strerror(c));
+		sim_advance(20);
+	}
+
+	v = TSG_INT_ENABLE_PULSE;
+	if ((c = sim_ioctl(fp, TSG_SET_INT_MASK, &v)) != 0)
+		errx(1, "TSG_SET_INT_MASK: %s", strerror(c));
+	for (j = 0; j < edges; ++j) {
+		sim_advance(1);
+		sim_edge(EDGE_PULSE, &it);
+	}
+
+	printf("%s, read %u nsec, write %u nsec%s\n\n", desc, sim_latency.read_ns,
+	    sim_latency.write_ns, sim_latency.spin ? "" : " (not spent)");
+	printf("%-28s %8s %7s %7s %9s %9s\n", "handler", "calls", "reads", "writes", "bus usec", "usec");
+	for (i = 0; (name = sim_sysctl_child("dev.tsg.0.bus", i)) != NULL; ++i) {
+		report(name, get("dev.tsg.0.bus.%s.%s", name, "calls"),
+		    get("dev.tsg.0.bus.%s.%s", name, "reads"),
+		    get("dev.tsg.0.bus.%s.%s", name, "writes"), 0,
+		    strcmp(name, "filter") == 0 ? it.filter_nsec :
+		    strcmp(name, "ithread") == 0 ? it.ithread_nsec : 0);
+		reads += get("dev.tsg.0.bus.%s.%s", name, "reads");
+		writes += get("dev.tsg.0.bus.%s.%s", name, "writes");
+	}
+	for (i = 0; (name = sim_sysctl_child("dev.tsg.0.ioctl", i)) != NULL; ++i) {
+		report(name, get("dev.tsg.0.ioctl.%s.%s", name, "calls"),
+		    get("dev.tsg.0.ioctl.%s.%s", name, "reads"),
+		    get("dev.tsg.0.ioctl.%s.%s", name, "writes"),
+		    get("dev.tsg.0.ioctl.%s.%s", name, "errors"),
+		    get("dev.tsg.0.ioctl.%s.%s", name, "nsec_total"));
+		reads += get("dev.tsg.0.ioctl.%s.%s", name, "reads");
+		writes += get("dev.tsg.0.ioctl.%s.%s", name, "writes");
+	}
+
+	sim_bar_stats(2, &bar);
+	printf("\nBAR2: %ju reads, %ju writes, %.3f msec on the bus\n",
+	    (uintmax_t)bar.reads, (uintmax_t)bar.writes, bar.nsec / 1e6);
+	if (dump) {
+		printf("\n");
+		sim_sysctl_dump(stdout, "dev.tsg.0");
+	}
+
+	sim_close(fp);
+	sim_detach();
+
+	if (reads != bar.reads || writes != bar.writes) {
+		fprintf(stderr, "tsgsim: the driver accounted for %ju reads and %ju writes\n",
+		    (uintmax_t)reads, (uintmax_t)writes);
+		exit(1);
+	}
+	exit(0);
+}